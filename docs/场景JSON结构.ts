@@ -16,6 +16,8 @@ type ImageType = "png" | "bmp"
 type MaterialType = "diffuse" | "diffuse_light" | "mirror" | "refract";
 // 字典
 type Dict<T> = { [key: string]: T }
+// BVH的构建方式
+type Builder = "sah" | "lbvh"
 // 旋转 , 如果是Vec2则先进行方位角旋转再进行仰角旋转 , 如果是Vec3则依次进行xyz的旋转
 type Rotate = Vec2<Deg> | Vec3<Deg>
 
@@ -48,7 +50,15 @@ interface RenderContext {
         // 是否有ui
         "ui": boolean,
         // 渲染的背景色
-        "background": Color
+        "background": Color,
+        // 仅rt , 路径的最大弹射次数
+        "max_depth"?: number, // 10
+        // 仅rt , 从第几次弹射开始按吞吐量进行俄罗斯轮盘赌
+        "rr_depth"?: number,  // 3
+        // 仅rt , 并行渲染的图块边长
+        "tile"?: PX,          // 16
+        // 仅rt , 场景BVH的构建方式 : 分桶SAH/Morton码(LBVH)
+        "builder"?: Builder   // "sah"
     },
     "image": {
         // 场景的名称
@@ -108,7 +118,7 @@ interface RenderContext {
             // 平面
             "flat"?: ObjectInfo<{}>[],
         },
-        // 模型
+        // 模型 , 光线追踪(rt)时作为三角形网格渲染 , 此时不使用shaderType
         "models": [
             {
                 "hide"?: boolean;
@@ -116,8 +126,24 @@ interface RenderContext {
                 "texturePath": string;
                 "shaderType": "vertex" | "fragment";
                 "transform"?: Transform;
+                // 仅rt使用 , 缺省时以texturePath作为漫反射纹理
+                "material"?: string | { "type": MaterialType, [key: string]: any },
+                // 仅rt使用 , 三角形BVH的构建方式
+                "builder"?: Builder
             }
         ],
+        // 原型 , 结构与objects和models相同 , 只构建一次 , 由实例共享 , 仅rt使用
+        "prototypes"?: Dict<{
+            "objects"?: RenderContext["scene"]["objects"],
+            "models"?: RenderContext["scene"]["models"]
+        }>,
+        // 实例 , 引用一个原型 , 缺省材质时沿用原型中各物体的材质
+        "instances"?: {
+            "hide"?: boolean,
+            "prototype": string,
+            "transform"?: Transform,
+            "material"?: string | { "type": MaterialType, [key: string]: any }
+        }[],
         // 导入其他scene信息(object和models)
     }
 }
\ No newline at end of file
@@ -7,16 +7,170 @@
 
 #include "math/vec.hpp"
 #include "data/ray.hpp"
+#include "data/packet.hpp"
 
 namespace mne {
 
+// 轴对齐包围盒 , 默认构造为空盒(min > max)
 struct AABB {
-    Vec3 min;
-    Vec3 max;
+    Vec3 min = make_vec(inf, inf, inf);
+    Vec3 max = make_vec(-inf, -inf, -inf);
 
-    // Todo 使用AABB优化射线检测
-    bool intersect(const Ray& ray) const {
-        return true;
+public:
+    // 包含整个空间的包围盒 , 用于无法计算边界的物体
+    static constexpr AABB Infinite() {
+        return {make_vec(-inf, -inf, -inf), make_vec(inf, inf, inf)};
+    }
+
+    // 合并两个包围盒
+    static constexpr AABB merge(const AABB& a, const AABB& b) {
+        return AABB{a}.expand(b);
+    }
+
+public:
+    // 扩展到包含点p
+    constexpr AABB& expand(const Vec3& p) {
+        for (int i = 0; i < 3; ++i) {
+            min[i] = std::min(min[i], p[i]);
+            max[i] = std::max(max[i], p[i]);
+        }
+        return *this;
+    }
+
+    // 扩展到包含另一个包围盒
+    constexpr AABB& expand(const AABB& box) {
+        for (int i = 0; i < 3; ++i) {
+            min[i] = std::min(min[i], box.min[i]);
+            max[i] = std::max(max[i], box.max[i]);
+        }
+        return *this;
+    }
+
+    // 是否为空盒
+    constexpr bool empty() const {
+        return min.x() > max.x() || min.y() > max.y() || min.z() > max.z();
+    }
+
+    // 是否为有限大小的非空盒
+    bool bounded() const {
+        for (int i = 0; i < 3; ++i) {
+            if (!std::isfinite(min[i]) || !std::isfinite(max[i])) return false;
+        }
+        return !empty();
+    }
+
+    // 中心点
+    constexpr Vec3 center() const { return (min + max) / 2_n; }
+
+    // 对角线
+    constexpr Vec3 diagonal() const { return max - min; }
+
+    // 表面积 , 空盒为0
+    constexpr number area() const {
+        if (empty()) return 0_n;
+        Vec3 d = diagonal();
+        return 2_n * (d.x() * d.y() + d.y() * d.z() + d.z() * d.x());
+    }
+
+    // 跨度最大的轴
+    constexpr int maxAxis() const {
+        Vec3 d = diagonal();
+        if (d.x() > d.y() && d.x() > d.z()) return 0;
+        return d.y() > d.z() ? 1 : 2;
+    }
+
+    // 点p在盒内的相对位置 , min为(0,0,0) , max为(1,1,1)
+    constexpr Vec3 offset(const Vec3& p) const {
+        Vec3 o = p - min;
+        for (int i = 0; i < 3; ++i) {
+            if (max[i] > min[i]) o[i] /= max[i] - min[i];
+        }
+        return o;
+    }
+
+public:
+    // 射线在(t_min,t_max)区间内是否穿过包围盒 , t_near为进入盒子的时刻
+    // 只使用min/max运算 , 方向分量为0时产生的NaN会被std::min/std::max的参数顺序忽略
+    bool intersect(const Ray& ray, number t_min, number t_max, number& t_near) const {
+        // 放宽出射时刻 , 避免舍入误差导致厚度为0的盒子被错误剔除
+        constexpr number robust = 1_n + 6_n * std::numeric_limits<number>::epsilon();
+        for (int i = 0; i < 3; ++i) {
+            number t0 = number((min[i] - ray.pos[i]) * ray.inv_dir[i]);
+            number t1 = number((max[i] - ray.pos[i]) * ray.inv_dir[i]);
+            t_min     = std::max(t_min, std::min(t0, t1));
+            t_max     = std::min(t_max, std::max(t0, t1) * robust);
+        }
+        return t_near = t_min, t_min <= t_max;
+    }
+
+    // 射线在hit的有效区间内是否穿过包围盒
+    bool intersect(const Ray& ray, const HitResult& hit) const {
+        number t_near;
+        return intersect(ray, number(hit.getMinTick()), number(hit.getMaxTick()), t_near);
+    }
+
+    // 光线包版本 , 返回在各自区间内穿过包围盒的通道
+    PacketMask intersect(const RayPacket& packet, PacketFloat t_min, PacketFloat t_max, PacketFloat& t_near) const {
+        const PacketFloat robust = 1.f + 6.f * std::numeric_limits<float>::epsilon();
+        for (int i = 0; i < 3; ++i) {
+            PacketFloat t0 = (PacketFloat(min[i]) - packet.pos[i]) * packet.inv_dir[i];
+            PacketFloat t1 = (PacketFloat(max[i]) - packet.pos[i]) * packet.inv_dir[i];
+            t_min          = vmax(t_min, vmin(t0, t1));
+            t_max          = vmin(t_max, vmax(t0, t1) * robust);
+        }
+        return t_near = t_min, t_min <= t_max;
+    }
+
+    // 光线包在hit的有效区间内是否穿过包围盒
+    PacketMask intersect(const RayPacket& packet, const PacketHit& hit) const {
+        PacketFloat t_near;
+        return intersect(packet, hit.t_min, hit.t_max, t_near);
+    }
+};
+
+// W个包围盒按坐标分量排列(SoA) , 一条射线用一次SIMD检测全部包围盒
+// 包围盒相对anchor保存 , 射线起点先按real减去anchor再转为float , 与单个包围盒一样在相减之后才损失精度
+template<int W>
+struct AABBGroup {
+    real  anchor[3]{}; // 相对的原点 , 世界空间为双精度时取整组包围盒的中心 , 否则为0
+    float min[3][W];
+    float max[3][W];
+
+    AABBGroup() {
+        for (int k = 0; k < 3; ++k) std::fill_n(min[k], W, inf), std::fill_n(max[k], W, -inf);
+    }
+
+    // 设置相对的原点 , 需要在set之前调用
+    void setAnchor(const AABB& bounds) {
+        if constexpr (!std::is_same_v<real, number>) {
+            for (int k = 0; k < 3; ++k) {
+                if (bounds.min[k] <= bounds.max[k]) anchor[k] = (real(bounds.min[k]) + real(bounds.max[k])) / 2;
+            }
+        }
+    }
+
+    // 偏移量向外取整 , 盒子不会因为舍入而缩小
+    void set(int i, const AABB& box) {
+        for (int k = 0; k < 3; ++k) {
+            real lo = real(box.min[k]) - anchor[k], hi = real(box.max[k]) - anchor[k];
+            min[k][i] = float(lo), max[k][i] = float(hi);
+            if (min[k][i] > lo) min[k][i] = std::nextafter(min[k][i], -inf);
+            if (max[k][i] < hi) max[k][i] = std::nextafter(max[k][i], inf);
+        }
+    }
+
+    // 射线在(t_min,t_max)区间内穿过的包围盒 , 与单个包围盒的检测步骤一致 , 空盒的结果无意义
+    SimdMask<W> intersect(const Ray& ray, number t_min, number t_max, SimdFloat<W>& t_near) const {
+        const SimdFloat<W> robust = 1.f + 6.f * std::numeric_limits<float>::epsilon();
+        SimdFloat<W>       lo = float(t_min), hi = float(t_max);
+        for (int k = 0; k < 3; ++k) {
+            SimdFloat<W> pos = float(ray.pos[k] - anchor[k]), inv = float(ray.inv_dir[k]);
+            SimdFloat<W> t0  = (SimdFloat<W>::load(min[k]) - pos) * inv;
+            SimdFloat<W> t1  = (SimdFloat<W>::load(max[k]) - pos) * inv;
+            lo               = vmax(lo, vmin(t0, t1));
+            hi               = vmin(hi, vmax(t0, t1) * robust);
+        }
+        return t_near = lo, lo <= hi;
     }
 };
 
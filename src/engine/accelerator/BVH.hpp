@@ -0,0 +1,718 @@
+﻿//
+// Created by IMEI on 2022/9/10.
+//
+
+#ifndef MINI_ENGINE_BVH_HPP
+#define MINI_ENGINE_BVH_HPP
+
+#include "accelerator/AABB.hpp"
+#include <vector>
+#include <chrono>
+#include <bit>
+#include <array>
+#include <atomic>
+#include <algorithm>
+
+/*
+ 层次包围盒(Bounding Volume Hierarchy)
+ - 只依赖图元的包围盒 , 图元本身的求交由回调完成 , 因此场景和模型可以共用
+ - 两种构建方式 : 表面积启发式(SAH)分桶自顶向下划分 , 或按Morton码排序后逐位划分(LBVH)
+ - 图元较多的范围用并行循环划分 , 剩下的子树再并行构建 , 分块的结果按固定顺序合并 , 与线程数无关
+ - 图元只移动时可以refit , 保持树的结构只更新包围盒 , SAH代价退化过多时再完整重建
+ - 节点按深度优先顺序存放在连续数组中 , 左孩子紧随父节点 , 父节点记录右孩子下标
+ - 遍历时先进入较近的孩子 , 并用HitResult当前的max_tick裁剪更远的节点
+ - 光线包整体遍历 , 节点和图元只对仍然有效的通道求交
+ - 单条射线遍历折叠后的宽树 , 每个节点有simd_width个孩子 , 孩子的包围盒按SoA存放 , 一次SIMD检测全部孩子
+ */
+
+namespace mne {
+
+class BVH {
+public:
+    struct Node {
+        AABB box;      // 节点包围盒
+        int  offset{}; // 叶子: 首个图元在indices中的位置 ; 内部节点: 右孩子的下标
+        int  count{};  // 叶子中的图元数量 , 0表示内部节点
+        int  axis{};   // 内部节点的划分轴
+    };
+
+    static constexpr int wide = simd_width; // 宽节点的孩子数量
+
+    // 宽节点 , 按缓存行对齐
+    struct alignas(64) WideNode {
+        AABBGroup<wide> box;         // 孩子的包围盒
+        int             child[wide]; // 内部孩子: 宽节点的下标 ; 叶子: 首个图元在indices中的位置
+        int             count[wide]; // 叶子中的图元数量 , 0表示内部孩子 , -1表示空位
+    };
+
+    // 构建方式
+    enum class Method {
+        SAH,  // 分桶SAH , 树的质量高
+        LBVH, // Morton码基数排序后按位划分 , 构建快
+    };
+
+    // 构建的统计信息
+    struct Stats {
+        int    primitives{}; // 图元数量
+        int    nodes{};      // 节点数量
+        int    wide_nodes{}; // 宽节点数量
+        int    leaves{};     // 叶子数量
+        int    depth{};      // 最大深度
+        int    refits{};     // 上次完整构建后refit的次数
+        Method method{};     // 构建方式
+        number sah{};        // SAH代价
+        double build_ms{};   // 构建耗时 , refit时为refit的耗时
+    };
+
+private:
+    static constexpr int    bucket_count = 12;  // SAH的分桶数量
+    static constexpr int    max_depth    = 64;  // 树的最大深度 , 也是遍历栈的大小
+    static constexpr number cost_trav    = 1_n; // 遍历一个节点的相对代价
+    static constexpr number cost_isect   = 1_n; // 和一个图元求交的相对代价
+
+    static constexpr int parallel_size = 1 << 14; // 图元数量达到此值的范围用并行循环处理
+    static constexpr int chunk_count   = 64;      // 并行循环的分块数量
+    static constexpr int morton_bits   = 10;      // Morton码每个轴的位数
+
+    static constexpr number rebuild_ratio = 1.5_n; // refit后的SAH代价超过构建时的此倍数则重建
+
+    // 构建时的临时节点 , 孩子用下标引用
+    struct BuildNode {
+        int begin{}, end{};        // 图元在indices中的范围
+        int left = -1, right = -1; // 孩子的下标 , 叶子为-1
+        int axis{};                // 划分轴
+    };
+
+    // 待划分的范围
+    struct BuildTask {
+        int node, begin, end, depth;
+        int bit; // LBVH下一个检查的Morton码位
+    };
+
+    // 构建过程共享的数据
+    struct BuildState {
+        Method                   method;
+        const std::vector<AABB>& bounds;
+        std::vector<Vec3>        centers{}; // 图元包围盒的中心
+        std::vector<uint32_t>    codes{};   // LBVH中与indices对应的Morton码 , 有序
+        std::vector<BuildNode>   nodes{};   // 最多2n-1个节点
+        std::atomic<int>         count{}; // 已分配的节点数量
+
+        int alloc() { return count.fetch_add(1); }
+    };
+
+    // SAH的分桶统计
+    struct Bins {
+        int  counts[bucket_count]{};
+        AABB boxes[bucket_count];
+
+        void merge(const Bins& other) {
+            for (int b = 0; b < bucket_count; ++b) counts[b] += other.counts[b], boxes[b].expand(other.boxes[b]);
+        }
+    };
+
+    std::vector<Node>     nodes;      // 深度优先排列的节点
+    std::vector<WideNode> wide_nodes; // 由nodes折叠而成 , 根节点在首位
+    std::vector<int>      indices;    // 叶子引用的图元下标
+    Stats                 stats;
+
+    int    leaf_size = 4;           // 不再强制划分的叶子大小
+    Method method    = Method::SAH; // 上次完整构建的方式
+    number build_sah{};             // 上次完整构建时的SAH代价
+
+public:
+    // 根据图元的包围盒构建 , bounds[i]对应下标为i的图元
+    void build(const std::vector<AABB>& bounds, int max_leaf = 4, Method mode = Method::SAH) {
+        auto start = std::chrono::steady_clock::now();
+
+        int n     = (int) bounds.size();
+        leaf_size = std::max(1, max_leaf);
+        method    = mode;
+        stats     = {};
+        nodes.clear();
+        wide_nodes.clear();
+        indices.resize(n);
+
+        if (n) {
+            BuildState state{method, bounds};
+            state.centers.resize(n);
+            state.nodes.resize(2 * n);
+            forChunks(0, n, [&](int, int lo, int hi) {
+                for (int i = lo; i < hi; ++i) indices[i] = i, state.centers[i] = bounds[i].center();
+            });
+            if (method == Method::LBVH) sortByMorton(state);
+            buildTree(state);
+
+            nodes.reserve(state.count);
+            flatten(state, 0, 1);
+            collapse(0);
+        }
+
+        stats.primitives = n;
+        stats.method     = method;
+        stats.nodes      = (int) nodes.size();
+        stats.wide_nodes = (int) wide_nodes.size();
+        stats.sah        = build_sah = cost();
+        stats.build_ms   = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    /**
+     * @brief 图元的数量和下标不变 , 只有包围盒变化时更新 , 保持树的结构自底向上重新计算包围盒
+     * @param bounds 图元新的包围盒
+     * @return 是否因为图元数量变化或SAH代价退化而完整重建
+     */
+    bool update(const std::vector<AABB>& bounds) {
+        if (nodes.empty() || (int) bounds.size() != stats.primitives) {
+            build(bounds, leaf_size, method);
+            return true;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        refit(bounds);
+        number sah = cost();
+        if (sah > build_sah * rebuild_ratio) {
+            build(bounds, leaf_size, method);
+            return true;
+        }
+        // 宽节点的划分依赖孩子的表面积 , 直接重新折叠
+        wide_nodes.clear();
+        collapse(0);
+
+        ++stats.refits;
+        stats.wide_nodes = (int) wide_nodes.size();
+        stats.sah        = sah;
+        stats.build_ms   = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        return false;
+    }
+
+    bool empty() const { return nodes.empty(); }
+
+    const Stats& getStats() const { return stats; }
+
+    static const char* methodName(Method mode) { return mode == Method::LBVH ? "lbvh" : "sah"; }
+
+    // 根节点的包围盒
+    AABB bounds() const { return nodes.empty() ? AABB{} : nodes[0].box; }
+
+    // 整棵树的SAH代价 , 以根节点表面积归一化
+    number cost() const {
+        if (nodes.empty()) return 0_n;
+        number root = nodes[0].box.area(), sum = 0_n;
+        if (root <= 0_n) return cost_isect * number(indices.size());
+        for (auto& node : nodes) {
+            number ratio = node.box.area() / root;
+            sum += node.count ? cost_isect * number(node.count) * ratio : cost_trav * ratio;
+        }
+        return sum;
+    }
+
+public:
+    /**
+     * @brief 查找射线的最近碰撞
+     * @param ray 射线
+     * @param hit 碰撞信息 , 用其[min_tick,max_tick]裁剪节点
+     * @param intersect bool(int index, HitResult& hit) , 和下标为index的图元求交 , 碰撞时需要更新hit
+     * @return 是否有碰撞
+     */
+    template<class F>
+    bool traverse(const Ray& ray, HitResult& hit, F&& intersect) const {
+        return search<false>(ray, hit, [&](int offset, int count, HitResult& h) {
+            bool found = false;
+            for (int i = offset; i < offset + count; ++i) {
+                if (intersect(indices[i], h)) found = true;
+            }
+            return found;
+        });
+    }
+
+    /**
+     * @brief 射线在区间内是否被任一图元遮挡 , 找到第一个遮挡物即返回
+     * @param ray 射线
+     * @param range 有效区间[min_tick,max_tick]
+     * @param test bool(int index) , 下标为index的图元是否在区间内遮挡射线
+     */
+    template<class F>
+    bool occluded(const Ray& ray, HitResult range, F&& test) const {
+        return search<true>(ray, range, [&](int offset, int count, HitResult&) {
+            for (int i = offset; i < offset + count; ++i) {
+                if (test(indices[i])) return true;
+            }
+            return false;
+        });
+    }
+
+    /**
+     * @brief 查找光线包中每条射线的最近碰撞
+     * @param packet 光线包 , 假定各通道的方向大致相同
+     * @param hit 碰撞信息 , 用各通道的[t_min,t_max]裁剪节点
+     * @param active 参与遍历的通道
+     * @param intersect PacketMask(int index, PacketMask active) , 和下标为index的图元求交 , 返回碰撞的通道并更新hit
+     * @return 有碰撞的通道
+     */
+    template<class F>
+    PacketMask traverse(const RayPacket& packet, PacketHit& hit, PacketMask active, F&& intersect) const {
+        return search<false>(packet, hit, active, [&](int offset, int count, PacketMask mask) {
+            PacketMask found = PacketMask::fromBits(0);
+            for (int i = offset; i < offset + count; ++i) found = found | intersect(indices[i], mask);
+            return found;
+        });
+    }
+
+    /**
+     * @brief 光线包版本的遮挡检测 , 被遮挡的通道不再参与遍历
+     * @param test PacketMask(int index, PacketMask active) , 返回被下标为index的图元遮挡的通道
+     * @return 被遮挡的通道
+     */
+    template<class F>
+    PacketMask occluded(const RayPacket& packet, const PacketHit& range, PacketMask active, F&& test) const {
+        return search<true>(packet, range, active, [&](int offset, int count, PacketMask mask) {
+            PacketMask found = PacketMask::fromBits(0);
+            for (int i = offset; i < offset + count && mask.any(); ++i) {
+                PacketMask hit = test(indices[i], mask);
+                found = found | hit, mask = mask & ~hit;
+            }
+            return found;
+        });
+    }
+
+public:
+    // 叶子中图元的排列 , 每个叶子引用其中连续的一段 , 第i个位置为下标order()[i]的图元
+    const std::vector<int>& order() const { return indices; }
+
+    // 按key(index)对每个叶子内的图元稳定排序 , 不改变树的结构
+    template<class K>
+    void sortLeaves(K&& key) {
+        for (auto& node : nodes) {
+            if (!node.count) continue;
+            std::stable_sort(indices.begin() + node.offset, indices.begin() + node.offset + node.count,
+                             [&](int a, int b) { return key(a) < key(b); });
+        }
+    }
+
+    /**
+     * @brief 按叶子求交的版本 , 适合把图元按order()的顺序连续存放 , 一次处理整个叶子
+     * @param leaf bool(int offset, int count, HitResult& hit) , 和order()中[offset,offset+count)位置的图元求交
+     */
+    template<class F>
+    bool traverseLeaves(const Ray& ray, HitResult& hit, F&& leaf) const {
+        return search<false>(ray, hit, leaf);
+    }
+
+    // 按叶子的遮挡检测 , leaf返回叶子中是否有图元在区间内遮挡射线
+    template<class F>
+    bool occludedLeaves(const Ray& ray, HitResult range, F&& leaf) const {
+        return search<true>(ray, range, leaf);
+    }
+
+    // 光线包按叶子求交 , leaf为PacketMask(int offset, int count, PacketMask active) , 返回碰撞的通道
+    template<class F>
+    PacketMask traverseLeaves(const RayPacket& packet, PacketHit& hit, PacketMask active, F&& leaf) const {
+        return search<false>(packet, hit, active, leaf);
+    }
+
+    // 光线包按叶子的遮挡检测 , leaf返回被叶子中图元遮挡的通道
+    template<class F>
+    PacketMask occludedLeaves(const RayPacket& packet, const PacketHit& range, PacketMask active, F&& leaf) const {
+        return search<true>(packet, range, active, leaf);
+    }
+
+private:
+    // 深度优先遍历宽树 , any_hit为真时找到任意碰撞即停止
+    template<bool any_hit, class F>
+    bool search(const Ray& ray, HitResult& hit, F&& leaf) const {
+        if (wide_nodes.empty()) return false;
+
+        // 宽树的深度不超过二叉树 , 每层最多留下wide-1个未访问的孩子
+        struct Entry {
+            int    offset; // 内部孩子为宽节点下标 , 叶子为首个图元的位置
+            int    count;  // 叶子中的图元数量 , 0表示内部孩子
+            number t_near;
+        };
+        Entry stack[max_depth * (wide - 1) + 1];
+        int   top = 0;
+        bool  ret = false;
+
+        stack[top++] = {0, 0, number(hit.getMinTick())};
+
+        while (top) {
+            auto [offset, count, t] = stack[--top];
+            // 入栈后已经找到更近的碰撞
+            if (t >= hit.getMaxTick()) continue;
+
+            if (count) {
+                if (!leaf(offset, count, hit)) continue;
+                if constexpr (any_hit) return true;
+                ret = true;
+                continue;
+            }
+
+            const WideNode& node = wide_nodes[offset];
+            SimdFloat<wide> t_near;
+            float           dist[wide];
+            int             bits = node.box.intersect(ray, float(hit.getMinTick()), float(hit.getMaxTick()), t_near).movemask();
+            t_near.store(dist);
+
+            // 按距离插入 , 远的孩子在下 , 最近的孩子最先出栈
+            int base = top;
+            for (; bits; bits &= bits - 1) {
+                int i = std::countr_zero(unsigned(bits));
+                if (node.count[i] < 0) continue;
+                Entry entry{node.child[i], node.count[i], dist[i]};
+                int   j = top++;
+                for (; j > base && stack[j - 1].t_near < entry.t_near; --j) stack[j] = stack[j - 1];
+                stack[j] = entry;
+            }
+        }
+        return ret;
+    }
+
+    // 光线包的深度优先遍历 , any_hit为真时碰撞的通道立即退出遍历
+    template<bool any_hit, class H, class F>
+    PacketMask search(const RayPacket& packet, H& hit, PacketMask active, F&& leaf) const {
+        PacketMask ret = PacketMask::fromBits(0);
+        if (nodes.empty() || active.none()) return ret;
+
+        // 以首个有效通道的方向决定孩子的访问顺序
+        int  lane = 0;
+        while (!active[lane]) ++lane;
+        bool negative[3];
+        for (int i = 0; i < 3; ++i) negative[i] = packet.dir[i][lane] < 0.f;
+
+        int stack[max_depth];
+        int top      = 0;
+        stack[top++] = 0;
+
+        while (top) {
+            int         index = stack[--top];
+            const Node& node  = nodes[index];
+            // 出栈时再检测 , 用已经收缩的t_max剔除通道
+            PacketFloat t_near;
+            PacketMask  mask = active & node.box.intersect(packet, hit.t_min, hit.t_max, t_near);
+            if (mask.none()) continue;
+
+            if (node.count) {
+                PacketMask found = leaf(node.offset, node.count, mask);
+                ret              = ret | found;
+                if constexpr (any_hit) {
+                    active = active & ~found;
+                    if (active.none()) break;
+                }
+                continue;
+            }
+
+            // 左孩子在划分轴上更靠近负方向 , 先压入远的孩子
+            int near = index + 1, far = node.offset;
+            if (negative[node.axis]) std::swap(near, far);
+            stack[top++] = far, stack[top++] = near;
+        }
+        return ret;
+    }
+
+    // 孩子的下标总是大于父节点 , 逆序遍历即可自底向上更新
+    void refit(const std::vector<AABB>& bounds) {
+        for (int i = (int) nodes.size() - 1; i >= 0; --i) {
+            Node& node = nodes[i];
+            if (node.count) {
+                node.box = {};
+                for (int k = node.offset; k < node.offset + node.count; ++k) node.box.expand(bounds[indices[k]]);
+            } else {
+                node.box = AABB::merge(nodes[i + 1].box, nodes[node.offset].box);
+            }
+        }
+    }
+
+    // 把以index为根的二叉子树折叠为宽节点 , 反复展开表面积最大的内部孩子直到填满 , 返回宽节点下标
+    int collapse(int index) {
+        int slots[wide]{index}, n = 1;
+        while (n < wide) {
+            int    best = -1;
+            number area = -1_n;
+            for (int i = 0; i < n; ++i) {
+                const Node& node = nodes[slots[i]];
+                if (!node.count && node.box.area() > area) best = i, area = node.box.area();
+            }
+            if (best < 0) break;
+            int node    = slots[best];
+            slots[best] = node + 1, slots[n++] = nodes[node].offset;
+        }
+
+        int ret = (int) wide_nodes.size();
+        wide_nodes.emplace_back();
+        wide_nodes[ret].box.setAnchor(nodes[index].box);
+        for (int i = 0; i < wide; ++i) wide_nodes[ret].count[i] = -1;
+        for (int i = 0; i < n; ++i) {
+            const Node& node = nodes[slots[i]];
+            int         child = node.count ? node.offset : collapse(slots[i]);
+            wide_nodes[ret].box.set(i, node.box);
+            wide_nodes[ret].child[i] = child, wide_nodes[ret].count[i] = node.count;
+        }
+        return ret;
+    }
+
+    // 图元较多的范围在当前线程逐个划分 , 划分内部的循环并行 ; 剩下的子树并行构建 , 子树内部串行
+    void buildTree(BuildState& state) {
+        int                    n = (int) indices.size();
+        std::vector<BuildTask> pending{{state.alloc(), 0, n, 1, 3 * morton_bits - 1}}, subtrees;
+        while (!pending.empty()) {
+            BuildTask task = pending.back();
+            pending.pop_back();
+            if (task.end - task.begin < parallel_size) {
+                subtrees.push_back(task);
+                continue;
+            }
+            BuildTask left, right;
+            if (split(state, task, left, right)) pending.push_back(left), pending.push_back(right);
+        }
+
+        // 先构建较大的子树
+        std::sort(subtrees.begin(), subtrees.end(), [](const BuildTask& a, const BuildTask& b) {
+            return a.end - a.begin > b.end - b.begin;
+        });
+        int count = (int) subtrees.size();
+#pragma omp parallel for schedule(dynamic, 1) if (count > 1)
+        for (int i = 0; i < count; ++i) buildSubtree(state, subtrees[i]);
+    }
+
+    void buildSubtree(BuildState& state, const BuildTask& task) {
+        BuildTask left, right;
+        if (!split(state, task, left, right)) return;
+        buildSubtree(state, left);
+        buildSubtree(state, right);
+    }
+
+    // 划分task的范围 , 成功时分配两个孩子 , 否则作为叶子
+    bool split(BuildState& state, const BuildTask& task, BuildTask& left, BuildTask& right) {
+        BuildNode& node = state.nodes[task.node];
+        node.begin = task.begin, node.end = task.end;
+
+        int axis = 0, bit = task.bit;
+        int mid  = state.method == Method::SAH ? splitSAH(state, task, axis) : splitMorton(state, task, axis, bit);
+        if (mid < 0) return false;
+
+        node.axis = axis, node.left = state.alloc(), node.right = state.alloc();
+        left  = {node.left, task.begin, mid, task.depth + 1, bit};
+        right = {node.right, mid, task.end, task.depth + 1, bit};
+        return true;
+    }
+
+    // 按SAH划分 , 返回划分点 , 返回-1表示作为叶子
+    int splitSAH(BuildState& state, const BuildTask& task, int& axis) {
+        int begin = task.begin, end = task.end, count = end - begin;
+        if (count <= 1 || task.depth >= max_depth - 1) return -1;
+
+        const auto& bounds  = state.bounds;
+        const auto& centers = state.centers;
+
+        // 范围的包围盒和中心的包围盒
+        using Boxes = std::pair<AABB, AABB>;
+        auto [box, center_box] = reduce<Boxes>(
+            begin, end,
+            [&](Boxes& ret, int lo, int hi) {
+                for (int i = lo; i < hi; ++i) ret.first.expand(bounds[indices[i]]), ret.second.expand(centers[indices[i]]);
+            },
+            [](Boxes& ret, const Boxes& part) { ret.first.expand(part.first), ret.second.expand(part.second); });
+
+        axis      = center_box.maxAxis();
+        number lo = center_box.min[axis], hi = center_box.max[axis];
+        // 所有中心重合 , 无法按空间划分
+        if (hi <= lo) return count <= leaf_size ? -1 : (begin + end) / 2;
+
+        auto bucketOf = [&](int prim) {
+            int b = int(number(bucket_count) * (centers[prim][axis] - lo) / (hi - lo));
+            return std::min(b, bucket_count - 1);
+        };
+
+        // 统计每个桶
+        Bins bins = reduce<Bins>(
+            begin, end,
+            [&](Bins& ret, int from, int to) {
+                for (int i = from; i < to; ++i) {
+                    int b = bucketOf(indices[i]);
+                    ++ret.counts[b], ret.boxes[b].expand(bounds[indices[i]]);
+                }
+            },
+            [](Bins& ret, const Bins& part) { ret.merge(part); });
+
+        // 从右向左累计 , 再从左向右扫描出代价最小的划分
+        number right_area[bucket_count]{};
+        int    right_count[bucket_count]{};
+        AABB   acc;
+        for (int b = bucket_count - 1, n = 0; b > 0; --b) {
+            acc.expand(bins.boxes[b]), n += bins.counts[b];
+            right_area[b] = acc.area(), right_count[b] = n;
+        }
+
+        number area     = box.area();
+        number inv_area = area > 0_n ? 1_n / area : 0_n;
+        number min_cost = inf;
+        int    best     = -1;
+        acc             = {};
+        for (int b = 0, n = 0; b < bucket_count - 1; ++b) {
+            acc.expand(bins.boxes[b]), n += bins.counts[b];
+            if (n == 0 || right_count[b + 1] == 0) continue;
+            number c = cost_trav + cost_isect * (number(n) * acc.area() + number(right_count[b + 1]) * right_area[b + 1]) * inv_area;
+            if (c < min_cost) min_cost = c, best = b;
+        }
+
+        // 划分不比直接求交更优时作为叶子
+        if (best < 0 || (count <= leaf_size && min_cost >= cost_isect * number(count))) return -1;
+
+        int mid = partition(begin, end, [&](int prim) { return bucketOf(prim) <= best; });
+        return mid == begin || mid == end ? (begin + end) / 2 : mid;
+    }
+
+    // 按Morton码从高到低第一个在范围内变化的位划分 , bit更新为孩子下一个检查的位
+    int splitMorton(const BuildState& state, const BuildTask& task, int& axis, int& bit) const {
+        int begin = task.begin, end = task.end, count = end - begin;
+        if (count <= leaf_size || task.depth >= max_depth - 1) return -1;
+
+        const auto& codes = state.codes;
+        for (; bit >= 0; --bit) {
+            uint32_t mask = 1u << bit;
+            // 范围内的编码有序且高位相同 , 两端相同则整个范围相同
+            if ((codes[begin] & mask) == (codes[end - 1] & mask)) continue;
+            auto it = std::partition_point(codes.begin() + begin, codes.begin() + end,
+                                           [&](uint32_t code) { return !(code & mask); });
+            axis = 2 - bit % 3;
+            return --bit, int(it - codes.begin());
+        }
+        // 编码全部相同 , 从中间划分
+        return (begin + end) / 2;
+    }
+
+    // 计算Morton码 , 再把indices按Morton码基数排序
+    void sortByMorton(BuildState& state) {
+        int n = (int) indices.size();
+
+        AABB center_box = reduce<AABB>(
+            0, n,
+            [&](AABB& ret, int lo, int hi) {
+                for (int i = lo; i < hi; ++i) ret.expand(state.centers[i]);
+            },
+            [](AABB& ret, const AABB& part) { ret.expand(part); });
+
+        auto& codes = state.codes;
+        codes.resize(n);
+        forChunks(0, n, [&](int, int lo, int hi) {
+            constexpr int scale = 1 << morton_bits;
+            for (int i = lo; i < hi; ++i) {
+                Vec3     o = center_box.offset(state.centers[i]);
+                uint32_t q[3];
+                for (int k = 0; k < 3; ++k) q[k] = uint32_t(std::clamp(int(o[k] * number(scale)), 0, scale - 1));
+                codes[i] = spread(q[0]) << 2 | spread(q[1]) << 1 | spread(q[2]);
+            }
+        });
+
+        // 每次按8位排序 , 分块统计后按(桶,块)的顺序分配位置 , 保证稳定
+        int                                 chunks = chunksOf(0, n);
+        std::vector<uint32_t>               next_codes(n);
+        std::vector<int>                    next_indices(n);
+        std::vector<std::array<int, 256>>   offsets(chunks);
+        for (int shift = 0; shift < 3 * morton_bits; shift += 8) {
+            for (auto& offset : offsets) offset.fill(0);
+            forChunks(0, n, [&](int c, int lo, int hi) {
+                for (int i = lo; i < hi; ++i) ++offsets[c][codes[i] >> shift & 255];
+            });
+            for (int d = 0, sum = 0; d < 256; ++d) {
+                for (auto& offset : offsets) std::swap(offset[d], sum), sum += offset[d];
+            }
+            forChunks(0, n, [&](int c, int lo, int hi) {
+                for (int i = lo; i < hi; ++i) {
+                    int pos           = offsets[c][codes[i] >> shift & 255]++;
+                    next_codes[pos]   = codes[i];
+                    next_indices[pos] = indices[i];
+                }
+            });
+            codes.swap(next_codes), indices.swap(next_indices);
+        }
+    }
+
+    // 10位整数的各位之间插入两个0
+    static uint32_t spread(uint32_t x) {
+        x = (x | x << 16) & 0x030000FF;
+        x = (x | x << 8) & 0x0300F00F;
+        x = (x | x << 4) & 0x030C30C3;
+        x = (x | x << 2) & 0x09249249;
+        return x;
+    }
+
+    // 把indices在[begin,end)中满足pred的图元移到前面 , 返回分界点 , 较大的范围并行且稳定
+    template<class P>
+    int partition(int begin, int end, P&& pred) {
+        int chunks = chunksOf(begin, end);
+        if (chunks == 1) {
+            return int(std::partition(indices.begin() + begin, indices.begin() + end, pred) - indices.begin());
+        }
+
+        // 每块满足条件的数量 , 前缀和得到每块在两侧的起始位置
+        std::vector<int> left(chunks + 1), right(chunks + 1);
+        forChunks(begin, end, [&](int c, int lo, int hi) {
+            left[c + 1] = (int) std::count_if(indices.begin() + lo, indices.begin() + hi, pred);
+        });
+        for (int c = 0; c < chunks; ++c) left[c + 1] += left[c];
+        int mid = begin + left[chunks];
+        for (int c = 0; c < chunks; ++c) right[c] = mid + chunkBegin(begin, end, c, chunks) - begin - left[c];
+
+        std::vector<int> temp(end - begin);
+        forChunks(begin, end, [&](int c, int lo, int hi) {
+            int l = left[c] + begin, r = right[c];
+            for (int i = lo; i < hi; ++i) temp[(pred(indices[i]) ? l++ : r++) - begin] = indices[i];
+        });
+        std::copy(temp.begin(), temp.end(), indices.begin() + begin);
+        return mid;
+    }
+
+    // 范围使用的分块数量 , 较小的范围不分块
+    static int chunksOf(int begin, int end) { return end - begin >= parallel_size ? chunk_count : 1; }
+
+    static int chunkBegin(int begin, int end, int c, int chunks) {
+        return begin + int(int64_t(end - begin) * c / chunks);
+    }
+
+    // 把[begin,end)分块并行执行work(chunk, lo, hi)
+    template<class F>
+    static void forChunks(int begin, int end, F&& work) {
+        int chunks = chunksOf(begin, end);
+        if (chunks == 1) return work(0, begin, end);
+#pragma omp parallel for schedule(static)
+        for (int c = 0; c < chunks; ++c) {
+            work(c, chunkBegin(begin, end, c, chunks), chunkBegin(begin, end, c + 1, chunks));
+        }
+    }
+
+    // 分块归约 , 每块的结果按块的顺序合并 , 因此结果与线程数无关
+    template<class T, class F, class M>
+    static T reduce(int begin, int end, F&& work, M&& merge) {
+        T ret{};
+        if (chunksOf(begin, end) == 1) return work(ret, begin, end), ret;
+        std::vector<T> parts(chunk_count);
+        forChunks(begin, end, [&](int c, int lo, int hi) { work(parts[c], lo, hi); });
+        for (auto& part : parts) merge(ret, part);
+        return ret;
+    }
+
+    // 按深度优先顺序展平临时树 , 自底向上计算包围盒 , 返回节点下标
+    int flatten(const BuildState& state, int index, int depth) {
+        const BuildNode& src = state.nodes[index];
+        int              ret = (int) nodes.size();
+        nodes.emplace_back();
+        stats.depth = std::max(stats.depth, depth);
+
+        if (src.left < 0) {
+            AABB box;
+            for (int i = src.begin; i < src.end; ++i) box.expand(state.bounds[indices[i]]);
+            nodes[ret] = {box, src.begin, src.end - src.begin};
+            ++stats.leaves;
+            return ret;
+        }
+
+        flatten(state, src.left, depth + 1);
+        int right  = flatten(state, src.right, depth + 1);
+        nodes[ret] = {AABB::merge(nodes[ret + 1].box, nodes[right].box), right, 0, src.axis};
+        return ret;
+    }
+};
+
+} // namespace mne
+
+#endif //MINI_ENGINE_BVH_HPP
@@ -0,0 +1,406 @@
+﻿//
+// Created by IMEI on 2022/9/15.
+//
+
+#ifndef MINI_ENGINE_COMPILED_SCENE_HPP
+#define MINI_ENGINE_COMPILED_SCENE_HPP
+
+#include <unordered_map>
+
+#include "accelerator/BVH.hpp"
+#include "implement/objects/sphere.hpp"
+#include "implement/objects/rectangle.hpp"
+#include "implement/objects/aggregate.hpp"
+#include "implement/material/baked.hpp"
+
+/*
+ 编译后的场景 , 光线追踪时代替逐个物体的虚函数求交
+ - 聚合对象(如立方体)展开为子物体 , 所有有界的物体共用一棵BVH
+ - 叶子内的物体按类型排序 , 椭球和矩形的参数按叶子中的顺序以SoA连续存放
+ - 叶子中连续的同类图元用simd_width宽的SIMD一次求交 , 不经过虚函数和指针
+ - 其他物体(网格,实例等)仍然通过IObject求交
+ - 碰撞记录物体的位置(slot) , 表面信息和材质按位置上的类型静态分派
+ - 物体集合不变时BVH只refit
+ */
+
+namespace mne {
+
+class CompiledScene {
+    using Lanes    = SimdFloat<simd_width>;
+    using LaneMask = SimdMask<simd_width>;
+
+    // 图元类型 , 也是叶子内的排列顺序
+    enum Kind : uint8_t {
+        kind_sphere,
+        kind_rect,
+        kind_other,
+    };
+
+    // 椭球 , 与Sphere的字段对应
+    struct Spheres {
+        std::vector<float> center[3];  // 球心
+        std::vector<float> axis[3][3]; // axis[i][k]为第i个轴方向的第k个分量
+        std::vector<float> length[3];  // 三个轴的半径
+    };
+
+    // 矩形 , 与Rectangle的字段对应
+    struct Rects {
+        std::vector<float> corner[3];        // 左下角
+        std::vector<float> x[3], y[3], z[3]; // 宽高方向和法线
+        std::vector<float> width, height;    // 宽高
+    };
+
+    BVH                         bvh;       // 有界物体的BVH
+    std::vector<const IObject*> list;      // 构建BVH时物体的顺序 , 用于判断能否refit
+    std::vector<Kind>           types;     // list中物体的类型
+    std::vector<const IObject*> unbounded; // 没有有效包围盒的物体 , 逐个求交
+
+    // 以下按叶子中的顺序排列 , 椭球和矩形只填充对应类型的位置
+    std::vector<Kind>           kinds;
+    std::vector<const IObject*> objects;
+    std::vector<int>            material_ids; // 物体的材质在materials中的下标
+    Spheres                     spheres;
+    Rects                       rects;
+
+    std::vector<MaterialBaked> materials; // 场景中出现的材质 , 相同的材质只保存一次
+
+public:
+    // 由场景物体构建 , 完整构建BVH时打印构建信息 , 物体不变只refit时不打印
+    void build(const std::vector<std::shared_ptr<IObject>>& scene, BVH::Method method) {
+        std::vector<const IObject*> last = std::move(list);
+        list.clear(), types.clear(), unbounded.clear();
+        for (const auto& ptr : scene) collect(ptr.get());
+
+        std::vector<AABB> bounds;
+        for (const auto* ptr : list) bounds.push_back(ptr->getAABB());
+        bool rebuilt = true;
+        if (list == last) {
+            rebuilt = bvh.update(bounds);
+        } else {
+            bvh.build(bounds, simd_width, method);
+        }
+        bvh.sortLeaves([&](int index) { return types[index]; });
+        fill();
+        if (rebuilt) printStats();
+    }
+
+    // 射线与场景的最近碰撞 , 只记录定位信息
+    bool intersect(const Ray& ray, HitResult& hit) const {
+        bool found = bvh.traverseLeaves(ray, hit, [&](int offset, int count, HitResult& h) {
+            return intersectLeaf<false>(ray, h, offset, count);
+        });
+        for (const auto* ptr : unbounded) {
+            if (ptr->intersect(ray, hit)) found = true;
+        }
+        return found;
+    }
+
+    // 射线在range的区间内是否被遮挡
+    bool occluded(const Ray& ray, const HitResult& range) const {
+        if (bvh.occludedLeaves(ray, range, [&](int offset, int count, HitResult& h) {
+                return intersectLeaf<true>(ray, h, offset, count);
+            })) return true;
+        for (const auto* ptr : unbounded) {
+            if (ptr->occluded(ray, range)) return true;
+        }
+        return false;
+    }
+
+    // 光线包版本 , 返回有碰撞的通道
+    PacketMask intersect(const RayPacket& packet, PacketHit& hit, PacketMask active) const {
+        PacketMask ret = bvh.traverseLeaves(packet, hit, active, [&](int offset, int count, PacketMask mask) {
+            return intersectLeaf<false>(packet, hit, mask, offset, count);
+        });
+        for (const auto* ptr : unbounded) ret = ret | ptr->intersect(packet, hit, active);
+        return ret;
+    }
+
+    // 光线包版本 , 返回被遮挡的通道
+    PacketMask occluded(const RayPacket& packet, const PacketHit& range, PacketMask active) const {
+        PacketMask ret = bvh.occludedLeaves(packet, range, active, [&](int offset, int count, PacketMask mask) {
+            PacketHit temp = range;
+            return intersectLeaf<true>(packet, temp, mask, offset, count);
+        });
+        for (const auto* ptr : unbounded) ret = ret | ptr->occluded(packet, range, active & ~ret);
+        return ret;
+    }
+
+    // 在hit上计算表面信息 , 编译过的椭球和矩形直接调用 , 不经过虚函数
+    void computeSurfaceInteraction(const Ray& ray, HitResult& hit) const {
+        switch (compiled(hit) ? kinds[hit.slot] : kind_other) {
+            case kind_sphere: return static_cast<const Sphere*>(hit.obj)->Sphere::computeSurfaceInteraction(ray, hit);
+            case kind_rect: return static_cast<const Rectangle*>(hit.obj)->Rectangle::computeSurfaceInteraction(ray, hit);
+            default: return hit.obj->computeSurfaceInteraction(ray, hit);
+        }
+    }
+
+    // 碰撞物体的材质 , 未编译的物体(如实例中的子物体)返回空
+    const MaterialBaked* material(const HitResult& hit) const {
+        return compiled(hit) ? &materials[material_ids[hit.slot]] : nullptr;
+    }
+
+private:
+    // hit.obj是否为编译场景中hit.slot位置的物体
+    bool compiled(const HitResult& hit) const {
+        return (unsigned) hit.slot < objects.size() && objects[hit.slot] == hit.obj;
+    }
+
+    // 按类型分类 , 聚合对象展开为子物体
+    void collect(const IObject* obj) {
+        if (!obj->getAABB().bounded()) {
+            unbounded.push_back(obj);
+        } else if (dynamic_cast<const Sphere*>(obj)) {
+            list.push_back(obj), types.push_back(kind_sphere);
+        } else if (dynamic_cast<const Rectangle*>(obj)) {
+            list.push_back(obj), types.push_back(kind_rect);
+        } else if (auto* group = dynamic_cast<const Aggregate*>(obj)) {
+            for (const auto& child : group->children) collect(child.get());
+        } else {
+            list.push_back(obj), types.push_back(kind_other);
+        }
+    }
+
+    // 打印场景BVH的构建信息
+    void printStats() const {
+        int   count[3]{};
+        auto& stats = bvh.getStats();
+        for (auto kind : types) ++count[kind];
+        printf("scene bvh : %s , object %d (sphere %d , rect %d , other %d) , unbounded %d , node %d , wide node %d , leaf %d , depth %d , sah %.2f , build %.3f ms \n",
+               BVH::methodName(stats.method), stats.primitives, count[kind_sphere], count[kind_rect], count[kind_other],
+               (int) unbounded.size(), stats.nodes, stats.wide_nodes, stats.leaves, stats.depth, stats.sah, stats.build_ms);
+    }
+
+    // 按叶子中的顺序填充 , 末尾多留simd_width-1个位置 , 使最后一组也能整组读取
+    void fill() {
+        const auto& order = bvh.order();
+        int         n = (int) order.size(), size = n + simd_width - 1;
+        kinds.resize(n), objects.resize(n), material_ids.resize(n);
+        for (int k = 0; k < 3; ++k) {
+            spheres.center[k].assign(size, 0.f), spheres.length[k].assign(size, 1.f);
+            for (int i = 0; i < 3; ++i) spheres.axis[i][k].assign(size, 0.f);
+            rects.corner[k].assign(size, 0.f), rects.x[k].assign(size, 0.f), rects.y[k].assign(size, 0.f), rects.z[k].assign(size, 0.f);
+        }
+        rects.width.assign(size, 1.f), rects.height.assign(size, 1.f);
+
+        std::unordered_map<const IMaterial*, int> ids;
+        materials.clear();
+        for (int j = 0; j < n; ++j) {
+            kinds[j] = types[order[j]], objects[j] = list[order[j]];
+
+            auto [it, added] = ids.try_emplace(&objects[j]->matRef(), (int) materials.size());
+            if (added) materials.emplace_back(objects[j]->matRef());
+            material_ids[j] = it->second;
+            if (kinds[j] == kind_sphere) {
+                auto*       ptr = static_cast<const Sphere*>(objects[j]);
+                const Vec3* n3[3]{&ptr->x, &ptr->y, &ptr->z};
+                for (int k = 0; k < 3; ++k) {
+                    spheres.center[k][j] = ptr->center[k], spheres.length[k][j] = ptr->length[k];
+                    for (int i = 0; i < 3; ++i) spheres.axis[i][k][j] = (*n3[i])[k];
+                }
+            } else if (kinds[j] == kind_rect) {
+                auto* ptr = static_cast<const Rectangle*>(objects[j]);
+                for (int k = 0; k < 3; ++k) {
+                    rects.corner[k][j] = ptr->leftBottom[k];
+                    rects.x[k][j] = ptr->x[k], rects.y[k][j] = ptr->y[k], rects.z[k][j] = ptr->z[k];
+                }
+                rects.width[j] = ptr->width, rects.height[j] = ptr->height;
+            }
+        }
+    }
+
+private:
+    // 求交核心 , V为SIMD类型 , 每个通道是一组射线和图元 , 计算步骤与Sphere和Rectangle的求交一致
+
+    template<class V>
+    static V dot3(const V (&a)[3], const V (&b)[3]) {
+        return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+    }
+
+    // 射线与椭球 , t为区间内较近的交点
+    template<class V>
+    static auto solveSphere(const V (&pos)[3], const V (&dir)[3], const V (&center)[3], const V (&axis)[3][3],
+                            const V (&length)[3], const V& t_min, const V& t_max, V& t) {
+        V oc[3];
+        for (int k = 0; k < 3; ++k) oc[k] = pos[k] - center[k];
+        V E = 0.f, F = 0.f, G = 0.f;
+        for (int i = 0; i < 3; ++i) {
+            V A = dot3(axis[i], oc);
+            V B = dot3(axis[i], dir);
+            V L = length[i] * length[i];
+            E   = E + A * A / L;
+            F   = F + V(2.f) * A * B / L;
+            G   = G + B * B / L;
+        }
+        V D2 = F * F - V(4.f) * (E - V(1.f)) * G;
+        V D  = sqrt(vmax(D2, V(0.f)));
+        V t1 = (-F - D) / (V(2.f) * G), t2 = (-F + D) / (V(2.f) * G);
+        // 优先取较近的t1
+        auto m1 = (t1 > t_min) & (t1 < t_max);
+        auto m2 = (t2 > t_min) & (t2 < t_max);
+        t       = select(m1, t1, t2);
+        return (D2 >= V(0.f)) & (m1 | m2);
+    }
+
+    // 射线与矩形 , t为与平面的交点
+    template<class V>
+    static auto solveRect(const V (&pos)[3], const V (&dir)[3], const V (&corner)[3], const V (&x)[3], const V (&y)[3],
+                          const V (&z)[3], const V& width, const V& height, const V& t_min, const V& t_max, V& t) {
+        V oc[3], vc[3];
+        for (int k = 0; k < 3; ++k) oc[k] = corner[k] - pos[k];
+        t = dot3(z, oc) / dot3(z, dir);
+        for (int k = 0; k < 3; ++k) vc[k] = pos[k] + t * dir[k] - corner[k];
+        V u = dot3(x, vc) / width, v = dot3(y, vc) / height;
+
+        V zero = 0.f, one = 1.f;
+        return (t >= zero) & (u >= zero) & (u <= one) & (v >= zero) & (v <= one) & (t > t_min) & (t < t_max);
+    }
+
+    // 从SoA的第j个位置读取simd_width个
+    static Lanes load(const std::vector<float>& data, int j) { return Lanes::load(data.data() + j); }
+
+    // 有效的前count个通道
+    static LaneMask firstLanes(int count) {
+        return LaneMask::fromBits(count >= simd_width ? (1u << simd_width) - 1 : (1u << count) - 1);
+    }
+
+    // 单条射线的起点和方向广播到各通道
+    static void broadcast(const Ray& ray, Lanes (&pos)[3], Lanes (&dir)[3]) {
+        for (int k = 0; k < 3; ++k) pos[k] = float(ray.pos[k]), dir[k] = float(ray.dir[k]);
+    }
+
+    // 起点的精度高于number时 , 先按real求出起点相对于第j个位置起各图元基点的偏移 , 再把基点置0
+    static void relative(const Ray& ray, const std::vector<float> (&base)[3], int j, Lanes (&pos)[3], Lanes (&origin)[3]) {
+        if constexpr (!std::is_same_v<real, number>) {
+            for (int k = 0; k < 3; ++k) {
+                float offset[simd_width];
+                for (int i = 0; i < simd_width; ++i) offset[i] = float(ray.pos[k] - real(base[k][j + i]));
+                pos[k] = Lanes::load(offset), origin[k] = 0.f;
+            }
+        }
+    }
+
+    // 按通道顺序依次更新hit , 与逐个求交的结果一致
+    template<bool any_hit>
+    bool resolve(HitResult& hit, LaneMask mask, const Lanes& t, int offset) const {
+        int bits = mask.movemask();
+        if (!bits) return false;
+        if constexpr (any_hit) return true;
+        float ticks[simd_width];
+        t.store(ticks);
+        bool found = false;
+        for (; bits; bits &= bits - 1) {
+            int i = std::countr_zero(unsigned(bits));
+            if (hit.setTick(ticks[i])) hit.obj = objects[offset + i], hit.slot = offset + i, found = true;
+        }
+        return found;
+    }
+
+    // 单条射线与一个叶子 , 叶子中依次是椭球,矩形和其他物体
+    template<bool any_hit>
+    bool intersectLeaf(const Ray& ray, HitResult& hit, int offset, int count) const {
+        int  end = offset + count, j = offset, begin;
+        bool found = false;
+
+        for (begin = j; j < end && kinds[j] == kind_sphere;) ++j;
+        if (j > begin && intersectSpheres<any_hit>(ray, hit, begin, j - begin)) {
+            if constexpr (any_hit) return true;
+            found = true;
+        }
+        for (begin = j; j < end && kinds[j] == kind_rect;) ++j;
+        if (j > begin && intersectRects<any_hit>(ray, hit, begin, j - begin)) {
+            if constexpr (any_hit) return true;
+            found = true;
+        }
+        for (; j < end; ++j) {
+            if constexpr (any_hit) {
+                if (objects[j]->occluded(ray, hit)) return true;
+            } else {
+                if (objects[j]->intersect(ray, hit)) hit.slot = j, found = true;
+            }
+        }
+        return found;
+    }
+
+    // 单条射线与连续的椭球 , 每次simd_width个
+    template<bool any_hit>
+    bool intersectSpheres(const Ray& ray, HitResult& hit, int offset, int count) const {
+        Lanes pos[3], dir[3];
+        broadcast(ray, pos, dir);
+        bool found = false;
+        for (int j = offset; j < offset + count; j += simd_width) {
+            Lanes center[3], axis[3][3], length[3], t;
+            for (int k = 0; k < 3; ++k) {
+                center[k] = load(spheres.center[k], j), length[k] = load(spheres.length[k], j);
+                for (int i = 0; i < 3; ++i) axis[i][k] = load(spheres.axis[i][k], j);
+            }
+            relative(ray, spheres.center, j, pos, center);
+            LaneMask mask = firstLanes(offset + count - j) &
+                            solveSphere(pos, dir, center, axis, length, Lanes(float(hit.getMinTick())), Lanes(float(hit.getMaxTick())), t);
+            if (resolve<any_hit>(hit, mask, t, j)) {
+                if constexpr (any_hit) return true;
+                found = true;
+            }
+        }
+        return found;
+    }
+
+    // 单条射线与连续的矩形 , 每次simd_width个
+    template<bool any_hit>
+    bool intersectRects(const Ray& ray, HitResult& hit, int offset, int count) const {
+        Lanes pos[3], dir[3];
+        broadcast(ray, pos, dir);
+        bool found = false;
+        for (int j = offset; j < offset + count; j += simd_width) {
+            Lanes corner[3], x[3], y[3], z[3], t;
+            for (int k = 0; k < 3; ++k) {
+                corner[k] = load(rects.corner[k], j);
+                x[k] = load(rects.x[k], j), y[k] = load(rects.y[k], j), z[k] = load(rects.z[k], j);
+            }
+            relative(ray, rects.corner, j, pos, corner);
+            LaneMask mask = firstLanes(offset + count - j) &
+                            solveRect(pos, dir, corner, x, y, z, load(rects.width, j), load(rects.height, j),
+                                      Lanes(float(hit.getMinTick())), Lanes(float(hit.getMaxTick())), t);
+            if (resolve<any_hit>(hit, mask, t, j)) {
+                if constexpr (any_hit) return true;
+                found = true;
+            }
+        }
+        return found;
+    }
+
+    // 光线包与一个叶子 , 每个图元的参数广播到各通道 , any_hit为真时被遮挡的通道不再求交
+    template<bool any_hit>
+    PacketMask intersectLeaf(const RayPacket& packet, PacketHit& hit, PacketMask active, int offset, int count) const {
+        PacketMask ret = PacketMask::fromBits(0);
+        for (int j = offset; j < offset + count && active.any(); ++j) {
+            PacketMask mask;
+            if (kinds[j] == kind_sphere) {
+                PacketFloat center[3], axis[3][3], length[3], t;
+                for (int k = 0; k < 3; ++k) {
+                    center[k] = spheres.center[k][j], length[k] = spheres.length[k][j];
+                    for (int i = 0; i < 3; ++i) axis[i][k] = spheres.axis[i][k][j];
+                }
+                mask = active & solveSphere(packet.pos, packet.dir, center, axis, length, hit.t_min, hit.t_max, t);
+                hit.update(mask, t, objects[j], j);
+            } else if (kinds[j] == kind_rect) {
+                PacketFloat corner[3], x[3], y[3], z[3], t;
+                for (int k = 0; k < 3; ++k) {
+                    corner[k] = rects.corner[k][j], x[k] = rects.x[k][j], y[k] = rects.y[k][j], z[k] = rects.z[k][j];
+                }
+                mask = active & solveRect(packet.pos, packet.dir, corner, x, y, z, PacketFloat(rects.width[j]),
+                                          PacketFloat(rects.height[j]), hit.t_min, hit.t_max, t);
+                hit.update(mask, t, objects[j], j);
+            } else {
+                mask = any_hit ? objects[j]->occluded(packet, hit, active) : objects[j]->intersect(packet, hit, active);
+                for (int bits = any_hit ? 0 : mask.movemask(); bits; bits &= bits - 1) hit.slot[std::countr_zero(unsigned(bits))] = j;
+            }
+            ret = ret | mask;
+            if constexpr (any_hit) active = active & ~mask;
+        }
+        return ret;
+    }
+};
+
+} // namespace mne
+
+#endif //MINI_ENGINE_COMPILED_SCENE_HPP
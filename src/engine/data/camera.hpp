@@ -6,6 +6,7 @@
 #define MINI_ENGINE_CAMERA_HPP
 
 #include "data/ray.hpp"
+#include "data/packet.hpp"
 #include "math/utils.hpp"
 
 namespace mne {
@@ -101,6 +102,19 @@ public:
         x /= (number) view_width, y /= (number) view_height;
         return Ray{eye_pos, (view_left_bottom + view_right * x + view_up * y - eye_pos).normalize()};
     }
+
+    // 光线包版本 , 每个通道的结果与makeRay相同
+    RayPacket makeRays(PacketFloat x, PacketFloat y) const {
+        x = x / PacketFloat((number) view_width), y = y / PacketFloat((number) view_height);
+        PacketFloat pos[3], dir[3];
+        for (int i = 0; i < 3; ++i) {
+            pos[i] = eye_pos[i];
+            dir[i] = PacketFloat(view_left_bottom[i]) + PacketFloat(view_right[i]) * x + PacketFloat(view_up[i]) * y - pos[i];
+        }
+        PacketFloat length = sqrt(dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2]);
+        for (auto& d : dir) d = d / length;
+        return {pos, dir};
+    }
 };
 
 } // namespace mne
@@ -27,6 +27,9 @@ struct Color {
             MathUtils::clamp(0_n, b, limit)};
     }
 
+    // 最大分量
+    constexpr number v_max() const { return std::max(r, std::max(g, b)); }
+
     // 颜色混合
     friend constexpr Color operator+(const Color& lhs, const Color& rhs) {
         return {lhs.r + rhs.r, lhs.g + rhs.g, lhs.b + rhs.b};
@@ -0,0 +1,102 @@
+﻿//
+// Created by IMEI on 2022/9/14.
+//
+
+#ifndef MINI_ENGINE_PACKET_HPP
+#define MINI_ENGINE_PACKET_HPP
+
+#include "data/ray.hpp"
+#include "math/simd.hpp"
+
+namespace mne {
+
+/*
+ 光线包 : 把方向相近的多条射线按SoA排列 , 用SIMD同时求交
+ - 每个通道对应一条射线 , 无效通道由掩码屏蔽
+ - 包的宽度在编译期由指令集决定 , AVX2为8 , 否则为4
+ */
+
+constexpr int packet_width = simd_width;
+
+using PacketFloat = SimdFloat<packet_width>;
+using PacketMask  = SimdMask<packet_width>;
+
+// 光线包
+struct RayPacket {
+    PacketFloat pos[3];     // 起点
+    PacketFloat dir[3];     // 方向
+    PacketFloat inv_dir[3]; // 方向各分量的倒数
+
+    RayPacket() = default;
+
+    RayPacket(const PacketFloat (&p)[3], const PacketFloat (&d)[3]) {
+        for (int i = 0; i < 3; ++i) {
+            pos[i] = p[i], dir[i] = d[i], inv_dir[i] = PacketFloat(1.f) / d[i];
+        }
+    }
+
+    // 由单独的射线组成光线包 , 无效通道填充为首条射线
+    static RayPacket fromRays(const Ray* rays, int count) {
+        float p[3][packet_width], d[3][packet_width];
+        for (int lane = 0; lane < packet_width; ++lane) {
+            const Ray& ray = rays[lane < count ? lane : 0];
+            for (int i = 0; i < 3; ++i) p[i][lane] = float(ray.pos[i]), d[i][lane] = ray.dir[i];
+        }
+        PacketFloat vp[3], vd[3];
+        for (int i = 0; i < 3; ++i) vp[i] = PacketFloat::load(p[i]), vd[i] = PacketFloat::load(d[i]);
+        return {vp, vd};
+    }
+
+    // 第lane个通道的射线
+    Ray ray(int lane) const {
+        return Ray{make_vec(pos[0][lane], pos[1][lane], pos[2][lane]),
+                   make_vec(dir[0][lane], dir[1][lane], dir[2][lane])};
+    }
+};
+
+// 常量向量与各通道向量的点积 , 与Vec3的点积按相同顺序累加
+inline PacketFloat dot(const Vec3& a, const PacketFloat (&b)[3]) {
+    return PacketFloat(a.x()) * b[0] + PacketFloat(a.y()) * b[1] + PacketFloat(a.z()) * b[2];
+}
+
+// 光线包的碰撞信息 , 与HitResult相同 , 求交时只记录定位信息
+struct PacketHit {
+    PacketFloat t_min = 0.001f; // 与HitResult的min_tick一致
+    PacketFloat t_max = inf;    // 随最近碰撞收缩
+
+    const IObject* obj[packet_width]{};   // 每个通道碰撞到的物体
+    int            prim[packet_width]{};  // 物体内的图元编号
+    Vec2           local[packet_width]{}; // 图元内的局部坐标
+    const IObject* inner[packet_width]{}; // 原型中实际碰撞的物体
+    int            slot[packet_width]{};  // 编译场景中的位置 , 与HitResult::slot相同
+
+    // 更新mask中通道的最近碰撞
+    void update(const PacketMask& mask, const PacketFloat& tick, const IObject* object, int index = -1) {
+        t_max    = select(mask, tick, t_max);
+        int bits = mask.movemask();
+        for (int lane = 0; lane < packet_width; ++lane) {
+            if (bits >> lane & 1) obj[lane] = object, slot[lane] = index;
+        }
+    }
+
+    // 用单条射线的碰撞更新第lane个通道
+    void set(int lane, const HitResult& hit) {
+        float t[packet_width];
+        t_max.store(t);
+        t[lane] = float(hit.getTick());
+        t_max   = PacketFloat::load(t);
+        obj[lane] = hit.obj, prim[lane] = hit.prim, local[lane] = hit.local, inner[lane] = hit.inner, slot[lane] = hit.slot;
+    }
+
+    // 第lane个通道的碰撞 , 未碰撞时返回false
+    bool get(int lane, HitResult& hit) const {
+        hit.reset();
+        if (!obj[lane] || !hit.setTick(t_max[lane])) return false;
+        hit.obj = obj[lane], hit.prim = prim[lane], hit.local = local[lane], hit.inner = inner[lane], hit.slot = slot[lane];
+        return true;
+    }
+};
+
+} // namespace mne
+
+#endif //MINI_ENGINE_PACKET_HPP
@@ -9,19 +9,25 @@
 
 namespace mne {
 
-// 射线,由光源发出
+// 射线,由光源发出 , 起点和求交距离使用世界空间的精度 , 方向使用number
 struct Ray {
-    Vec3 pos; // 起点
-    Vec3 dir; // 方向
+    Vec3r pos;     // 起点
+    Vec3  dir;     // 方向
+    Vec3  inv_dir; // 方向各分量的倒数 , 供包围盒检测使用
 
-    Vec3 at(number tick) const {
-        return pos + tick * dir;
+    Ray() = default;
+
+    Ray(const Vec3r& pos, const Vec3& dir):
+        pos(pos), dir(dir), inv_dir(make_vec(1_n / dir.x(), 1_n / dir.y(), 1_n / dir.z())) {}
+
+    Vec3r at(real tick) const {
+        return pos + tick * dir.cast<real>();
     }
 
     // 和平面的交点tick
-    number flat(Vec3 c, Vec3 n) const {
+    real flat(const Vec3r& c, const Vec3& n) const {
         // (o + t * d - c) n = 0
-        Vec3 oc = c - pos;
+        Vec3r oc = c - pos;
         return (n * oc) / (n * dir);
     }
 };
@@ -29,23 +35,28 @@ struct Ray {
 class IObject;
 
 // 射线碰撞点信息
+// 求交时只记录tick , 物体和图元内的定位信息 , 表面信息由最近的物体在求交结束后统一计算
 class HitResult {
 public:
-    Vec3 point;     // 点坐标
+    Vec3r point;    // 点坐标
     Vec3 normal;    // 面法线
     Vec2 uv;        // 纹理坐标
     bool back{};    // 是否位于背面
     bool success{}; // 是否成功碰撞
 
-    const IObject* obj{}; // 碰撞到的物体
+    const IObject* obj{};   // 碰撞到的物体 , 聚合对象中为实际碰撞的子物体
+    int            prim{};  // 物体内的图元编号 , 如网格中的三角形
+    Vec2           local{}; // 图元内的局部坐标 , 如三角形的重心坐标
+    const IObject* inner{}; // 碰撞到实例时 , 原型中实际碰撞的物体
+    int            slot = -1; // 碰撞物体在编译场景中的位置 , 用于静态分派 , -1表示未编译
 private:
-    number tick{}; // point = pos + tick * dir
-    number min_tick = 0.001_n;
-    number max_tick = inf;
+    real tick{}; // point = pos + tick * dir
+    real min_tick = 0.001_n;
+    real max_tick = inf;
 
 public:
     // 重新开始一次采样
-    void reset() { max_tick = inf, success = false, obj = nullptr; }
+    void reset() { max_tick = inf, success = false, obj = nullptr, slot = -1; }
 
     // outSide为朝外的法线
     void setNormal(Vec3 outSide, const Ray& ray) {
@@ -53,7 +64,7 @@ public:
         normal = back ? -outSide : outSide;
     }
 
-    bool setTick(number val) {
+    bool setTick(real val) {
         if (val > min_tick && val < max_tick) {
             return tick = max_tick = val, success = true;
         } else {
@@ -62,13 +73,21 @@ public:
     }
 
     // 假定要求v1 < v2
-    bool setTick(number v1, number v2) {
+    bool setTick(real v1, real v2) {
         return setTick(v1) || setTick(v2);
     }
 
-    Vec3 getPoint(const Ray& ray) const {
+    Vec3r getPoint(const Ray& ray) const {
         return ray.at(tick);
     }
+
+    // 有效碰撞区间(min_tick,max_tick) , max_tick随最近碰撞收缩
+    real getMinTick() const { return min_tick; }
+    real getMaxTick() const { return max_tick; }
+    real getTick() const { return tick; }
+
+    // 收缩有效区间的上界
+    void clip(real val) { max_tick = std::min(max_tick, val); }
 };
 
 } // namespace mne
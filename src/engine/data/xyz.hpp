@@ -71,6 +71,14 @@ public:
     // 获取三个方向的长度
     Vec3 getScale() const { return {x.length(), y.length(), z.length()}; }
 
+    // 与toWorld等价的仿射矩阵 , 四列依次为x,y,z,o
+    Mat44 toMat() const {
+        return {make_vec(x.x(), y.x(), z.x(), o.x()),
+                make_vec(x.y(), y.y(), z.y(), o.y()),
+                make_vec(x.z(), y.z(), z.z(), o.z()),
+                make_vec(0, 0, 0, 1)};
+    }
+
 public:
     // 标准坐标系中的坐标转换为this坐标系的坐标
     Vec3 toLocal(Vec3 v) const {
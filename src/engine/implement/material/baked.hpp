@@ -0,0 +1,59 @@
+﻿//
+// Created by IMEI on 2022/9/15.
+//
+
+#ifndef MINI_ENGINE_MATERIAL_BAKED_HPP
+#define MINI_ENGINE_MATERIAL_BAKED_HPP
+
+#include <variant>
+
+#include "diffuse.hpp"
+#include "mirror.hpp"
+#include "implement/texture/baked.hpp"
+
+namespace mne {
+
+// 静态分派的材质 , 已知类型的参数按值保存 , 采样时不经过虚函数 , 其他类型仍通过IMaterial
+class MaterialBaked {
+    struct Diffuse {
+        TextureBaked albedo;
+    };
+
+    struct Mirror {
+        Color albedo;
+    };
+
+    std::variant<const IMaterial*, Diffuse, Mirror> material;
+    TextureBaked                                    emission; // 光源的纹理
+    bool                                            light{};  // 是否为光源
+
+public:
+    explicit MaterialBaked(const IMaterial& mat):
+        emission(mat.emission.get()), light(mat.isLight()) {
+        if (auto* diffuse = dynamic_cast<const MaterialDiffuse*>(&mat)) {
+            material = Diffuse{diffuse->albedo.get()};
+        } else if (auto* mirror = dynamic_cast<const MaterialMirror*>(&mat)) {
+            material = Mirror{mirror->albedo};
+        } else {
+            material = &mat;
+        }
+    }
+
+public:
+    // 与IMaterial相同的接口
+    Color emit(const Vec2& uv) const { return light ? emission.value(uv) : Color{}; }
+
+    bool isLight() const { return light; }
+
+    void sample(const Vec3& in_dir, const HitResult& hit, BxDFResult& bxdf) const {
+        switch (material.index()) {
+            case 1: return MaterialDiffuse::sample(std::get_if<1>(&material)->albedo, hit, bxdf);
+            case 2: return MaterialMirror::sample(std::get_if<2>(&material)->albedo, in_dir, hit, bxdf);
+            default: return (*std::get_if<0>(&material))->sample(in_dir, hit, bxdf);
+        }
+    }
+};
+
+} // namespace mne
+
+#endif //MINI_ENGINE_MATERIAL_BAKED_HPP
@@ -12,6 +12,8 @@ namespace mne {
 
 // 漫反射材质
 class MaterialDiffuse: public IMaterial {
+    friend class MaterialBaked;
+
     std::shared_ptr<ITexture> albedo;
 
 public:
@@ -24,9 +26,15 @@ public:
     }
 
     void sample(const Vec3& in_dir, const HitResult& hit, BxDFResult& bxdf) const final {
+        sample(*albedo, hit, bxdf);
+    }
+
+    // 采样的实现 , T为具体的纹理类型时可以静态分派
+    template<class T>
+    static void sample(const T& albedo, const HitResult& hit, BxDFResult& bxdf) {
         bxdf.specular = false;
         bxdf.out_dir  = VecUtils::sampleHalfSphere(hit.normal);
-        bxdf.albedo   = albedo->value(hit.uv) / pi2;
+        bxdf.albedo   = albedo.value(hit.uv) / pi2;
         bxdf.pdf      = (bxdf.out_dir * hit.normal) / pi2;
     }
 };
@@ -10,6 +10,8 @@
 namespace mne {
 
 class MaterialMirror: public IMaterial {
+    friend class MaterialBaked;
+
     Color albedo;
 
 public:
@@ -18,6 +20,10 @@ public:
     }
 
     void sample(const Vec3& in_dir, const HitResult& hit, BxDFResult& bxdf) const final {
+        sample(albedo, in_dir, hit, bxdf);
+    }
+
+    static void sample(const Color& albedo, const Vec3& in_dir, const HitResult& hit, BxDFResult& bxdf) {
         bxdf.specular = true;
         bxdf.out_dir  = VecUtils::reflect(in_dir, hit.normal);        // 镜面反射
         bxdf.albedo   = (albedo / (bxdf.out_dir * hit.normal + eps)); // 菲涅尔效应 , clamp会出现黑边
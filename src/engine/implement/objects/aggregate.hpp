@@ -6,20 +6,70 @@
 #define MINI_ENGINE_AGGREGATE_HPP
 
 #include "interface/object.hpp"
+#include "accelerator/BVH.hpp"
 #include "rectangle.hpp"
 
 namespace mne {
 
-// 聚合对象
+// 聚合对象 , 子物体较多时用BVH组织
 class Aggregate: public IObject {
+    friend class CompiledScene;
+
+    static constexpr int bvh_threshold = 8; // 子物体达到此数量时构建BVH
+
+    BVH                         blas;      // 有界子物体的BVH , 坐标与子物体相同
+    std::vector<const IObject*> bounded;   // blas中的图元下标对应的子物体
+    std::vector<const IObject*> unbounded; // 逐个求交的子物体
+
 protected:
+    // 子物体依次收缩hit的区间 , hit.obj记录最近的子物体
     void intersection(const Ray& ray, HitResult& hit) const override {
-        HitResult temp = hit;
-        for (const auto& ptr : children) {
-            if (ptr->intersect(ray, temp)) {
-                hit = temp;
+        bool found = blas.traverse(ray, hit, [&](int index, HitResult& h) {
+            return bounded[index]->intersect(ray, h);
+        });
+        for (const auto* ptr : unbounded) {
+            if (ptr->intersect(ray, hit)) found = true;
+        }
+        hit.success = found;
+    }
+
+    bool occlusion(const Ray& ray, HitResult& hit) const override {
+        if (blas.occluded(ray, hit, [&](int index) { return bounded[index]->occluded(ray, hit); })) return true;
+        for (const auto* ptr : unbounded) {
+            if (ptr->occluded(ray, hit)) return true;
+        }
+        return false;
+    }
+
+    PacketMask intersection(const RayPacket& packet, PacketHit& hit, PacketMask active) const override {
+        PacketMask ret = blas.traverse(packet, hit, active, [&](int index, PacketMask mask) {
+            return bounded[index]->intersect(packet, hit, mask);
+        });
+        for (const auto* ptr : unbounded) ret = ret | ptr->intersect(packet, hit, active);
+        return ret;
+    }
+
+    // 所有子对象包围盒的并集 , 有界的子物体不变时只refit BVH , 否则重建
+    void updateAABB() override {
+        bool                        use_bvh = (int) children.size() >= bvh_threshold;
+        std::vector<AABB>           bounds;
+        std::vector<const IObject*> last = std::move(bounded);
+        bbox = {};
+        bounded.clear(), unbounded.clear();
+        for (auto& ptr : children) {
+            const AABB& box = ptr->getAABB();
+            bbox.expand(box);
+            if (use_bvh && box.bounded()) {
+                bounded.push_back(ptr.get()), bounds.push_back(box);
+            } else {
+                unbounded.push_back(ptr.get());
             }
         }
+        if (bounded == last) {
+            blas.update(bounds);
+        } else {
+            blas.build(bounds);
+        }
     }
 
     // Todo 随机采样
@@ -30,6 +80,12 @@ protected:
         for (auto& ptr : children) sum += ptr->area();
         return sum;
     }
+
+    number area(const Mat33& linear) const final {
+        number sum = 0_n;
+        for (auto& ptr : children) sum += ptr->area(linear);
+        return sum;
+    }
 };
 
 } // namespace mne
@@ -10,11 +10,10 @@
 
 namespace mne {
 
-// 立方体
+// 立方体 , 六个面在构造时创建 , 之后随立方体的变换一起更新
 class Cube: public Aggregate {
 public:
-    void onSetTransform() final {
-        children.clear();
+    Cube() {
         // 前后
         auto front = load(
             std::make_shared<Rectangle>(), material,
@@ -39,6 +38,12 @@ public:
         // 添加到子对象中
         addChild({front, back, top, bottom, left, right});
     }
+
+private:
+    // 六个面共用立方体的材质
+    void onSetMaterial() final {
+        for (auto& face : children) face->setMaterial(material);
+    }
 };
 
 } // namespace mne
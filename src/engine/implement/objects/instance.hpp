@@ -0,0 +1,137 @@
+﻿//
+// Created by IMEI on 2022/9/15.
+//
+
+#ifndef MINI_ENGINE_INSTANCE_HPP
+#define MINI_ENGINE_INSTANCE_HPP
+
+#include "interface/object.hpp"
+
+/*
+ 几何实例
+ - 原型(网格,立方体,矩形组等)只构建一次 , 在自身坐标系中持有BVH , 多个实例共享
+ - 实例只保存变换和材质 , 求交时把射线变换到原型的坐标系 , 方向不归一化 , 因此tick与世界坐标系一致
+ - 场景的BVH只包含实例的包围盒 , 构成两级加速结构
+ - 原型中不能再包含实例
+ */
+
+namespace mne {
+
+class Instance final: public IObject {
+    std::shared_ptr<const IObject> prototype; // 共享的原型 , 不挂到对象树上
+
+    bool inherit = true; // 是否沿用原型中各物体自身的材质
+
+    number world_area{}; // 变换后的表面积 , 随变换更新
+
+public:
+    explicit Instance(std::shared_ptr<const IObject> prototype):
+        prototype(std::move(prototype)) { world_area = this->prototype->area(); }
+
+public:
+    // 在原型上按面积均匀采样后变换到世界坐标系
+    // 非均匀缩放下面元的缩放比例随法线变化 , 世界坐标系中不再均匀 , 由pdf_scale修正
+    void sampleLight(LightResult& result) const final {
+        prototype->sampleLight(result);
+        Vec3 normal   = result.normal;
+        result.point  = MatUtils::applyPoint(toWorldMat(), result.point);
+        result.normal = nToWorld(normal);
+        // 面元的缩放比例 |det(L)| * |L^-T * n|
+        Vec3 cofactor;
+        for (int i = 0; i < 3; ++i) cofactor[i] = number(toLocalMat().col(i).as<3>() * normal);
+        number scale     = number(std::abs(toWorldMat().det())) * cofactor.length();
+        result.pdf_scale = world_area / (prototype->area() * scale);
+    }
+
+    number area() const final { return world_area; }
+
+    number area(const Mat33& linear) const final { return prototype->area(linear * linearPart()); }
+
+protected:
+    void intersection(const Ray& ray, HitResult& hit) const final {
+        HitResult sub = hit;
+        if (!prototype->intersect(toLocal(ray), sub)) return;
+        hit.setTick(sub.getTick());
+        hit.prim = sub.prim, hit.local = sub.local, hit.inner = sub.obj;
+    }
+
+    bool occlusion(const Ray& ray, HitResult& hit) const final {
+        return prototype->occluded(toLocal(ray), hit);
+    }
+
+    PacketMask intersection(const RayPacket& packet, PacketHit& hit, PacketMask active) const final {
+        const Mat44r& m = toLocalMat();
+        PacketFloat   p[3], d[3];
+        for (int i = 0; i < 3; ++i) {
+            p[i] = PacketFloat(float(m.at(i, 3)));
+            d[i] = PacketFloat(0.f);
+            for (int j = 0; j < 3; ++j) {
+                p[i] = p[i] + PacketFloat(float(m.at(i, j))) * packet.pos[j];
+                d[i] = d[i] + PacketFloat(float(m.at(i, j))) * packet.dir[j];
+            }
+        }
+
+        PacketHit  sub = hit;
+        PacketMask ret = prototype->intersect(RayPacket(p, d), sub, active);
+        int        bits = ret.movemask();
+        for (int lane = 0; lane < packet_width; ++lane) {
+            if (!(bits >> lane & 1)) continue;
+            hit.obj[lane] = this, hit.inner[lane] = sub.obj[lane];
+            hit.prim[lane] = sub.prim[lane], hit.local[lane] = sub.local[lane];
+        }
+        hit.t_max = select(ret, sub.t_max, hit.t_max);
+        return ret;
+    }
+
+    // 原型的包围盒的8个顶点变换后的包围盒
+    void updateAABB() final {
+        const AABB& box = prototype->getAABB();
+        if (!box.bounded()) {
+            bbox = AABB::Infinite();
+            return;
+        }
+        bbox = {};
+        for (int i = 0; i < 8; ++i) {
+            Vec3 corner = make_vec(i & 1 ? box.max.x() : box.min.x(),
+                                   i & 2 ? box.max.y() : box.min.y(),
+                                   i & 4 ? box.max.z() : box.min.z());
+            bbox.expand(pToWorld(corner));
+        }
+    }
+
+private:
+    void onSetTransform() final { world_area = prototype->area(linearPart()); }
+
+    // 变换矩阵的线性部分
+    Mat33 linearPart() const {
+        Mat33 ret;
+        for (int i = 0; i < 3; ++i) {
+            for (int j = 0; j < 3; ++j) ret.at(i, j) = number(toWorldMat().at(i, j));
+        }
+        return ret;
+    }
+
+    // 实例没有单独指定材质时沿用原型的材质
+    void onSetMaterial() final {
+        inherit = prototype && material == prototype->getMaterial();
+    }
+
+    Ray toLocal(const Ray& ray) const {
+        return {MatUtils::applyPoint(toLocalMat(), ray.pos), MatUtils::applyDir(toLocalMat(), ray.dir).cast<number>()};
+    }
+
+public:
+    // 在原型的坐标系中计算表面信息 , 再变换到世界坐标系
+    void computeSurfaceInteraction(const Ray& ray, HitResult& hit) const final {
+        HitResult sub = hit;
+        hit.inner->computeSurfaceInteraction(toLocal(ray), sub);
+        hit.point  = hit.getPoint(ray);
+        hit.normal = nToWorld(sub.normal);
+        hit.uv = sub.uv, hit.back = sub.back;
+        if (inherit) hit.obj = hit.inner;
+    }
+};
+
+} // namespace mne
+
+#endif //MINI_ENGINE_INSTANCE_HPP
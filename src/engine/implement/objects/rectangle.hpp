@@ -11,6 +11,8 @@ namespace mne {
 
 // 矩形
 class Rectangle: public IObject {
+    friend class CompiledScene;
+
     Vec3 leftBottom = make_vec(-0.5_n, -0.5_n, 0); // 左下角
     // +x和+y轴, z=normal
     Vec3   x = VecUtils::X, y = VecUtils::Y, z = VecUtils::Z;
@@ -29,18 +31,47 @@ public:
 
     number area() const final { return width * height; }
 
+    number area(const Mat33& linear) const final {
+        return (linear * (x * width)).cross(linear * (y * height)).length();
+    }
+
 protected:
     void intersection(const Ray& ray, HitResult& hit) const final {
         // 和平面求交
-        number tick = ray.flat(leftBottom, z);
+        real tick = ray.flat(leftBottom, z);
         if (tick < 0_n) return;
-        hit.point = ray.at(tick);
-        hit.uv    = mapping_uv(hit.point);
-        if (hit.uv.v_min() < 0 || hit.uv.v_max() > 1) return;
+        Vec2 uv = mapping_uv(ray.at(tick));
+        if (uv.v_min() < 0 || uv.v_max() > 1) return;
         hit.setTick(tick);
+    }
+
+    // 光线包版本 , 与单条射线的计算步骤一致
+    PacketMask intersection(const RayPacket& packet, PacketHit& hit, PacketMask active) const final {
+        // 和平面求交
+        PacketFloat oc[3], p[3];
+        for (int k = 0; k < 3; ++k) oc[k] = PacketFloat(leftBottom[k]) - packet.pos[k];
+        PacketFloat tick = dot(z, oc) / dot(z, packet.dir);
+        for (int k = 0; k < 3; ++k) p[k] = packet.pos[k] + tick * packet.dir[k];
+        // 求偏移量
+        PacketFloat vc[3];
+        for (int k = 0; k < 3; ++k) vc[k] = p[k] - PacketFloat(leftBottom[k]);
+        PacketFloat u = dot(x, vc) / PacketFloat(width), v = dot(y, vc) / PacketFloat(height);
+
+        PacketFloat zero = 0.f, one = 1.f;
+        PacketMask  ret  = active & (tick >= zero) & (u >= zero) & (u <= one) & (v >= zero) & (v <= one) &
+                         (tick > hit.t_min) & (tick < hit.t_max);
+        hit.update(ret, tick, this);
+        return ret;
+    }
+
+public:
+    void computeSurfaceInteraction(const Ray& ray, HitResult& hit) const final {
+        hit.point = hit.getPoint(ray);
+        hit.uv    = mapping_uv(hit.point);
         hit.setNormal(z, ray);
     }
 
+protected:
     void onSetTransform() final {
         // 更新宽高轴
         std::tie(x, y) = std::make_tuple(
@@ -51,10 +82,16 @@ protected:
         leftBottom = pToWorld(make_vec(-0.5_n, -0.5_n, 0));
     }
 
+    void updateAABB() final {
+        Vec3 w = x * width, h = y * height;
+        bbox   = {};
+        bbox.expand(leftBottom).expand(leftBottom + w).expand(leftBottom + h).expand(leftBottom + w + h);
+    }
+
 private:
-    Vec2 mapping_uv(const Vec3& p) const {
+    Vec2 mapping_uv(const Vec3r& p) const {
         // 求偏移量
-        Vec3   vc = p - leftBottom;
+        Vec3   vc = (p - leftBottom).cast<number>();
         number ox = x * vc, oy = y * vc;
         return {ox / width, oy / height};
     }
@@ -13,6 +13,8 @@ namespace mne {
 
 // 椭球
 class Sphere final: public IObject {
+    friend class CompiledScene;
+
     // 球心位置
     Vec3 center = make_vec(0, 0, 0);
     // xyz方向的长度
@@ -38,6 +40,15 @@ protected:
         x /= length.x(), y /= length.y(), z /= length.z();
     }
 
+    void updateAABB() final {
+        // 椭球为c + sum(u_i * l_i * n_i) , |u|<=1 , 在第k个坐标轴上的半径为|(l_i * n_i[k])_i|
+        Vec3 ax = x * length.x(), ay = y * length.y(), az = z * length.z(), half;
+        for (int k = 0; k < 3; ++k) {
+            half[k] = std::sqrt(ax[k] * ax[k] + ay[k] * ay[k] + az[k] * az[k]);
+        }
+        bbox = {center - half, center + half};
+    }
+
 public:
     // Todo 椭球采样
     // 随机在物体表面上采样一个点
@@ -53,9 +64,53 @@ public:
         //return 4 * pi * radius * radius;
     }
 
+    number area(const Mat33&) const final { return 0; }
+
 protected:
     // 椭球与光线的交点
     void intersection(const Ray& ray, HitResult& hit) const final {
+        number t1, t2;
+        if (solve(ray, t1, t2)) hit.setTick(t1, t2);
+    }
+
+    // 光线包版本 , 与单条射线的计算步骤一致
+    PacketMask intersection(const RayPacket& packet, PacketHit& hit, PacketMask active) const final {
+        PacketFloat oc[3];
+        for (int k = 0; k < 3; ++k) oc[k] = packet.pos[k] - PacketFloat(center[k]);
+
+        Vec3        n[3]{x, y, z}, l = length;
+        PacketFloat E = 0.f, F = 0.f, G = 0.f;
+        for (int i = 0; i < 3; ++i) {
+            PacketFloat A = dot(n[i], oc);
+            PacketFloat B = dot(n[i], packet.dir);
+            PacketFloat L = l[i] * l[i];
+            E = E + A * A / L;
+            F = F + PacketFloat(2.f) * A * B / L;
+            G = G + B * B / L;
+        }
+        PacketFloat D2 = F * F - PacketFloat(4.f) * (E - PacketFloat(1.f)) * G;
+        PacketFloat D  = sqrt(vmax(D2, PacketFloat(0.f)));
+        PacketFloat t1 = (-F - D) / (PacketFloat(2.f) * G), t2 = (-F + D) / (PacketFloat(2.f) * G);
+
+        // 优先取较近的t1
+        PacketMask m1 = (t1 > hit.t_min) & (t1 < hit.t_max);
+        PacketMask m2 = (t2 > hit.t_min) & (t2 < hit.t_max);
+        PacketMask ret = active & (D2 >= PacketFloat(0.f)) & (m1 | m2);
+        hit.update(ret, select(m1, t1, t2), this);
+        return ret;
+    }
+
+public:
+    void computeSurfaceInteraction(const Ray& ray, HitResult& hit) const final {
+        // 法线方向与梯度方向一致(x/a,y/b,z/c)
+        Vec3 normal = ((hit.point = hit.getPoint(ray)) - center).div(length).cast<number>();
+        hit.setNormal(normal, ray);
+        hit.uv = mapping_uv(normal);
+    }
+
+private:
+    // 求解射线与椭球的两个交点 , t1 <= t2 , 无解时返回false
+    bool solve(const Ray& ray, number& t1, number& t2) const {
         // 点到椭圆dx,dy,dz三个轴的距离记作x,y,z , 三轴长度为a,b,c
         // 记n123分别为dx,dy,dz , l123分别为abc , d123分别为x,y,z
         // \sum (d_i/l_i)^2 = 1
@@ -66,7 +121,7 @@ protected:
         // E + F * t + G * t ^ 2 = 1
         // D = sqrt(F^2 - 4 * E * G)
         // t = (-F ± D) / (2 * G)
-        Vec3 c = center, o = ray.pos, d = ray.dir, oc = o - c;
+        Vec3 d = ray.dir, oc = (ray.pos - center).cast<number>();
         // 填充轴信息
         Vec3   n[3]{x, y, z}, l = length; // 三个轴的方向向量及其长度
         number E{}, F{}, G{};
@@ -79,19 +134,12 @@ protected:
             G += B * B / L;
         }
         number D2 = F * F - 4 * (E - 1_n) * G;
-        if (D2 < 0) return; // 无解
-        number D  = std::sqrt(D2);
-        number t1 = (-F - D) / (2 * G), t2 = (-F + D) / (2 * G);
-
-        if (!hit.setTick(t1, t2)) return;
-
-        // 法线方向与梯度方向一致(x/a,y/b,z/c)
-        Vec3 normal = ((hit.point = hit.getPoint(ray)) - center).div(l);
-        hit.setNormal(normal, ray);
-        hit.uv = mapping_uv(normal);
+        if (D2 < 0) return false; // 无解
+        number D = std::sqrt(D2);
+        t1 = (-F - D) / (2 * G), t2 = (-F + D) / (2 * G);
+        return true;
     }
 
-private:
     // 方向向量映射到纹理坐标
     Vec2 mapping_uv(const Vec3& normal) const {
         auto [theta, phi] =
@@ -0,0 +1,213 @@
+﻿//
+// Created by IMEI on 2022/9/11.
+//
+
+#ifndef MINI_ENGINE_TRIANGLE_HPP
+#define MINI_ENGINE_TRIANGLE_HPP
+
+#include "interface/object.hpp"
+#include "accelerator/BVH.hpp"
+#include "store/model.hpp"
+
+namespace mne {
+
+// 三角形网格 , 直接引用Model中的顶点和纹理坐标 , 在模型的局部坐标系中求交
+class TriangleMesh final: public IObject {
+    std::shared_ptr<const Model> model; // 共享的模型数据
+
+    BVH blas; // 局部坐标系下的三角形BVH
+
+    std::vector<number> areas; // 世界坐标系下三角形面积的前缀和
+
+public:
+    TriangleMesh(std::shared_ptr<const Model> model, BVH::Method method = BVH::Method::SAH):
+        model(std::move(model)) {
+        blas.build(faceBounds(), 4, method);
+    }
+
+public:
+    // 按面积选择三角形 , 再在三角形内均匀采样
+    void sampleLight(LightResult& result) const final {
+        if (areas.empty() || areas.back() <= 0_n) return;
+        number pick = RandomUtils::randFloat() * areas.back();
+        int    face = int(std::upper_bound(areas.begin(), areas.end(), pick) - areas.begin());
+        face        = std::min(face, face_count() - 1);
+
+        number su = std::sqrt(RandomUtils::randFloat()), b1 = 1_n - su, b2 = RandomUtils::randFloat() * su;
+
+        auto [a, b, c] = vertex(face);
+        result.point   = MatUtils::applyPoint(toWorldMat(), a * (1_n - b1 - b2) + b * b1 + c * b2);
+        result.normal  = nToWorld((b - a).cross(c - a));
+        result.uv      = texCoord(face, b1, b2);
+    }
+
+    number area() const final { return areas.empty() ? 0_n : areas.back(); }
+
+    number area(const Mat33& linear) const final {
+        number sum = 0_n;
+        for (int i = 0; i < face_count(); ++i) {
+            auto [a, b, c] = vertex(i);
+            Vec3 e1 = linear * MatUtils::applyDir(toWorldMat(), b - a).cast<number>();
+            Vec3 e2 = linear * MatUtils::applyDir(toWorldMat(), c - a).cast<number>();
+            sum += e1.cross(e2).length() / 2;
+        }
+        return sum;
+    }
+
+    // 模型的顶点移动后调用 , 三角形的数量和顺序不变 , refit三角形BVH并更新面积和包围盒
+    void refit() {
+        blas.update(faceBounds());
+        onSetTransform();
+        refreshAABB();
+    }
+
+protected:
+    void onSetTransform() final {
+        // 世界坐标系下的面积
+        areas.resize(face_count());
+        number sum = 0_n;
+        for (int i = 0; i < face_count(); ++i) {
+            auto [a, b, c] = vertex(i);
+            Vec3r e1 = MatUtils::applyDir(toWorldMat(), b - a), e2 = MatUtils::applyDir(toWorldMat(), c - a);
+            areas[i] = sum += number(e1.cross(e2).length() / 2);
+        }
+    }
+
+    void updateAABB() final {
+        // 变换局部包围盒的8个顶点
+        AABB local = blas.bounds();
+        bbox       = {};
+        if (local.empty()) return;
+        for (int i = 0; i < 8; ++i) {
+            Vec3 corner = make_vec(i & 1 ? local.max.x() : local.min.x(),
+                                   i & 2 ? local.max.y() : local.min.y(),
+                                   i & 4 ? local.max.z() : local.min.z());
+            bbox.expand(MatUtils::applyPoint(toWorldMat(), corner).cast<number>());
+        }
+    }
+
+    void intersection(const Ray& ray, HitResult& hit) const final {
+        Ray        local = toLocal(ray);
+        Watertight wt(local);
+
+        int    face = -1;
+        number b1{}, b2{};
+        blas.traverse(local, hit, [&](int index, HitResult& h) {
+            auto [a, b, c] = vertex(index);
+            number t, u, v;
+            if (wt.intersect(a, b, c, t, u, v) && h.setTick(t)) {
+                return face = index, b1 = u, b2 = v, true;
+            }
+            return false;
+        });
+        if (face >= 0) hit.prim = face, hit.local = {b1, b2};
+    }
+
+public:
+    void computeSurfaceInteraction(const Ray& ray, HitResult& hit) const final {
+        auto [a, b, c] = vertex(hit.prim);
+        hit.point      = hit.getPoint(ray);
+        hit.setNormal(nToWorld((b - a).cross(c - a)), ray);
+        hit.uv = texCoord(hit.prim, hit.local.x(), hit.local.y());
+    }
+
+    // 局部三角形BVH的构建信息
+    const BVH::Stats& stats() const { return blas.getStats(); }
+
+protected:
+
+    bool occlusion(const Ray& ray, HitResult& hit) const final {
+        Ray        local = toLocal(ray);
+        Watertight wt(local);
+        return blas.occluded(local, hit, [&](int index) {
+            auto [a, b, c] = vertex(index);
+            number t, u, v;
+            return wt.intersect(a, b, c, t, u, v) && t > hit.getMinTick() && t < hit.getMaxTick();
+        });
+    }
+
+private:
+    // 变换到局部坐标系 , 方向不归一化以保持tick不变
+    Ray toLocal(const Ray& ray) const {
+        return {MatUtils::applyPoint(toLocalMat(), ray.pos), MatUtils::applyDir(toLocalMat(), ray.dir).cast<number>()};
+    }
+
+    // 水密的射线三角形求交 , 共享边上的点不会被相邻三角形同时漏掉
+    // Sven Woop et al. Watertight Ray/Triangle Intersection. JCGT 2013
+    struct Watertight {
+        Vec3r  org;
+        int    kx, ky, kz;
+        number sx, sy, sz;
+
+        explicit Watertight(const Ray& ray):
+            org(ray.pos) {
+            Vec3 d = ray.dir, ad = make_vec(std::abs(d.x()), std::abs(d.y()), std::abs(d.z()));
+            // 以分量最大的轴作为z轴 , 保持坐标系的手性
+            kz = ad.x() > ad.y() ? (ad.x() > ad.z() ? 0 : 2) : (ad.y() > ad.z() ? 1 : 2);
+            kx = (kz + 1) % 3, ky = (kx + 1) % 3;
+            if (d[kz] < 0) std::swap(kx, ky);
+            sx = d[kx] / d[kz], sy = d[ky] / d[kz], sz = 1_n / d[kz];
+        }
+
+        // 返回是否相交 , t为tick , (u,v)为b和c的重心坐标
+        bool intersect(const Vec3& a, const Vec3& b, const Vec3& c, number& t, number& u, number& v) const {
+            Vec3 A = (a - org).cast<number>(), B = (b - org).cast<number>(), C = (c - org).cast<number>();
+            // 剪切变换后射线沿+z方向
+            number ax = A[kx] - sx * A[kz], ay = A[ky] - sy * A[kz];
+            number bx = B[kx] - sx * B[kz], by = B[ky] - sy * B[kz];
+            number cx = C[kx] - sx * C[kz], cy = C[ky] - sy * C[kz];
+            // 二维边函数
+            number U = cx * by - cy * bx;
+            number V = ax * cy - ay * cx;
+            number W = bx * ay - by * ax;
+            // 落在边上时用双精度重新计算
+            if (U == 0_n || V == 0_n || W == 0_n) {
+                U = number(double(cx) * double(by) - double(cy) * double(bx));
+                V = number(double(ax) * double(cy) - double(ay) * double(cx));
+                W = number(double(bx) * double(ay) - double(by) * double(ax));
+            }
+            if ((U < 0_n || V < 0_n || W < 0_n) && (U > 0_n || V > 0_n || W > 0_n)) return false;
+
+            number det = U + V + W;
+            if (det == 0_n) return false;
+
+            number T = U * (sz * A[kz]) + V * (sz * B[kz]) + W * (sz * C[kz]);
+            number inv = 1_n / det;
+            t = T * inv, u = V * inv, v = W * inv;
+            return true;
+        }
+    };
+
+    int face_count() const { return model->face_count(); }
+
+    // 每个三角形的局部包围盒
+    std::vector<AABB> faceBounds() const {
+        std::vector<AABB> bounds(face_count());
+        for (int i = 0; i < face_count(); ++i) {
+            auto [a, b, c] = vertex(i);
+            bounds[i].expand(a).expand(b).expand(c);
+        }
+        return bounds;
+    }
+
+    // 第i个三角形的三个顶点(局部坐标)
+    std::tuple<Vec3, Vec3, Vec3> vertex(int i) const {
+        auto& abc = model->triangles[i];
+        return {model->vertices[abc[0].pos], model->vertices[abc[1].pos], model->vertices[abc[2].pos]};
+    }
+
+    // 按重心坐标插值纹理坐标 , 缺少纹理坐标时返回(0,0)
+    Vec2 texCoord(int i, number b1, number b2) const {
+        auto& abc = model->triangles[i];
+        int   n   = (int) model->textures.size();
+        for (auto& node : abc) {
+            if (node.tex < 0 || node.tex >= n) return {};
+        }
+        auto& tex = model->textures;
+        return tex[abc[0].tex] * (1_n - b1 - b2) + tex[abc[1].tex] * b1 + tex[abc[2].tex] * b2;
+    }
+};
+
+} // namespace mne
+
+#endif //MINI_ENGINE_TRIANGLE_HPP
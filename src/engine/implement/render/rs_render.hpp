@@ -7,7 +7,9 @@
 
 #include "interface/shader.hpp"
 #include "interface/render.hpp"
+#include "implement/shader/baked.hpp"
 #include "math/utils.hpp"
+#include "math/simd.hpp"
 #include "store/image.hpp"
 #include "store/model.hpp"
 #include "data/camera.hpp"
@@ -64,230 +66,470 @@ class RsRender: public IRender {
 private:
     int vw{}, vh{}; // 视口大小
 
-    std::vector<number> depth; // z_buffer缓存
+    std::vector<number> depth;    // z_buffer缓存 , 按列存储
+    int                 stride{}; // 深度缓存的列长 , vh按片段宽度对齐
 
-    Mat44 trans_mat{};      // 当前模型的变换矩阵
-    Mat44 trans_mat_inv{};  // trans_mat.invert()的缓存
-    Mat44 screen_mat{};     // 当前模型的屏幕变换矩阵
-    Mat44 screen_mat_inv{}; // screen_mat.invert()的缓存
+    number w_near{}, w_far{}; // 近平面和远平面处的齐次坐标w
 
     struct VertexData {
-        Vec3  position;
+        Vec4  position; // 屏幕空间的齐次坐标 , 装配后为透视除法的结果 , w保持不变
         Vec2  texCoord;
         Color color{};
     };
 
+    /*
+     三个阶段的流水线 , 每帧只有一个并行区域
+     - 顶点处理 : 所有模型去重后的顶点并行执行顶点着色器 , 结果写入顶点缓存
+     - 图元装配 : 单线程按索引从顶点缓存组装三角形 , 裁剪后按包围矩形分到覆盖的分块中
+     - 光栅化 : 分块之间并行 , 每个分块独占自己范围内的深度和颜色 , 无需同步
+     分块内按提交顺序绘制三角形 , 结果与逐个三角形顺序绘制一致
+     */
+    static constexpr int tile_size = 32; // 分块边长(像素)
+
+    /*
+     片段 : 一列中连续的span个像素 , 用SIMD同时插值和深度检测
+     - 片段的起点按span对齐 , 不会跨越分块和列 , 深度缓存按列对齐后整段读写
+     - 覆盖范围由边函数逐列精确求出 , 超出范围的通道由掩码屏蔽
+     */
+    static constexpr int span = simd_width;
+    static_assert(tile_size % span == 0);
+
+    using SpanFloat = SimdFloat<span>;
+    using SpanMask  = SimdMask<span>;
+
+    // 边函数使用定点坐标 , 顶点吸附到1/16像素 , 逐像素步进没有误差
+    static constexpr int     sub_bits  = 4;
+    static constexpr int64_t sub_one   = int64_t(1) << sub_bits;
+    static constexpr number  max_coord = number(1 << 20); // 定点坐标的上限 , 边函数不会溢出
+    static constexpr number  guard     = number(1 << 18); // 视口四周保护带的宽度 , 带内的顶点不裁剪 , 带外的裁剪到带上
+
+    // 属性在屏幕空间的平面方程 , 以(ax,ay)为原点
+    struct Plane {
+        number value, dx, dy; // 原点处的值和x,y方向的增量
+
+        number at(number ox, number oy) const { return value + dx * ox + dy * oy; }
+    };
+
+    /*
+     三角形设置 , 每个三角形只计算一次
+     - 边函数 e = A*x + B*y + C , x,y为定点坐标 , 三角形内e>=0
+     - 深度,纹理坐标和颜色在屏幕空间线性插值 , 沿y方向逐像素累加
+     */
+    struct TriangleSetup {
+        int64_t A[3], B[3], C[3];   // 三条边的边函数
+        int     x0, x1, y0, y1;     // 像素范围 , 已约束到视口内
+        number  ax, ay;             // 平面方程的原点 , 即第一个顶点
+        number  z_min;              // 顶点的最小深度
+        Plane   z, u, v, r, g, b;   // 深度,纹理坐标和颜色
+    };
+
+    int tiles_x{}, tiles_y{}; // 横纵分块数
+
+    std::vector<VertexData>                vertices;     // 当前帧顶点着色器的输出 , 按模型顺序排列
+    std::vector<int>                       vertex_begin; // 每个模型的顶点在vertices中的起始位置
+    std::vector<std::array<VertexData, 3>> triangles;    // 当前帧屏幕空间的三角形 , 按模型顺序排列
+    std::vector<TriangleSetup>             setups;    // triangles对应的三角形设置
+    std::vector<int>                       model_end; // 每个模型的三角形在triangles中的结束位置
+    std::vector<ShaderBaked>               shaders;   // 每个模型的着色器 , 按具体类型分派
+    std::vector<std::vector<int>>          bins;      // 每个分块覆盖的三角形编号 , 升序
+
+    /*
+     层次深度 : 每个分块记录深度缓存的最大值 , 最小深度不小于它的三角形被整体跳过
+     - 最大值只会变小 , 过期的值仍然是保守的上界
+     - 每绘制hiz_period个三角形和每个模型绘制完后重新统计
+     */
+    static constexpr int hiz_period = 16;
+
+    std::vector<number> tile_far; // 每个分块深度的上界
+
+public:
+    bool front_to_back = true; // 模型按由近到远的顺序绘制 , 使后绘制的三角形更多地被层次深度剔除
+
+    // 面剔除方式 , 正面为模型中逆时针环绕的面
+    enum class Cull { None, Back, Front };
+
+    Cull cull = Cull::Back;
+
 public:
     void render() final {
         std::tie(vw, vh) = camera->getWH(); // 视口大小
         image->resize(vw, vh, background);   // 重置图片
-        depth.assign(vw * vh, inf);          // 重置深度缓存
+        stride = (vh + span - 1) / span * span;
+        depth.assign(vw * stride, inf); // 重置深度缓存
 
         // 转观察空间
         auto view_mat = camera->getViewMat();
         // 转裁剪空间
         auto project_mat = camera->getProjectionMat();
         // 转屏幕空间
-        screen_mat     = camera->getScreenMat();
-        screen_mat_inv = screen_mat.invert();
-
-        // 渲染每个model
+        auto screen_mat = camera->getScreenMat();
+        // w只与观察空间的深度有关
+        w_near = (project_mat * make_vec(0, 0, camera->view_near, 1)).w();
+        w_far  = (project_mat * make_vec(0, 0, camera->view_far, 1)).w();
+
+        // 重置分块
+        tiles_x = (vw + tile_size - 1) / tile_size, tiles_y = (vh + tile_size - 1) / tile_size;
+        bins.resize(tiles_x * tiles_y);
+        for (auto& bin : bins) bin.clear();
+        tile_far.assign(tiles_x * tiles_y, inf);
+        triangles.clear(), model_end.clear(), shaders.clear();
+
+        // 每个模型的变换矩阵
+        std::vector<std::pair<Model*, Mat44>> draws;
         for (const auto& model : scene->models) {
             model->transform.rotate.y() += pi / 60;
             // 局部转世界空间
             auto model_mat = model->transform.get_matrix();
+            auto trans_mat = MatUtils::merge(model_mat, view_mat, project_mat, screen_mat);
+            // 包围盒在视锥外的模型不做顶点处理
+            if (!inFrustum(*model, trans_mat)) continue;
+            draws.emplace_back(model.get(), trans_mat);
+        }
+        // 按模型原点的深度排序
+        if (front_to_back) {
+            std::stable_sort(draws.begin(), draws.end(), [](const auto& a, const auto& b) {
+                return (a.second * Vec3{}).z() < (b.second * Vec3{}).z();
+            });
+        }
 
-            trans_mat     = MatUtils::merge(model_mat, view_mat, project_mat, screen_mat);
-            trans_mat_inv = trans_mat.invert();
-
-            // 渲染每个面
-            for (auto& abc : model->triangles) {
-                std::array<VertexData, 3> data;
-                // 为每个顶点执行顶点着色器,输出裁剪空间的坐标
-                for (int i = 0; i < 3; ++i) {
-                    auto& drf = data[i];
-                    drf       = {model->vertices[abc[i].pos], model->textures[abc[i].tex]};
-                    model->shader->vertex(drf.position, drf.texCoord, trans_mat, drf.color);
+        // 着色器按具体类型分派一次 , 分配顶点缓存
+        vertex_begin.clear();
+        int vertex_count = 0;
+        for (const auto& [model, trans_mat] : draws) {
+            model->shader->bind();
+            shaders.push_back(bakeShader(model->shader.get()));
+            vertex_begin.push_back(vertex_count);
+            vertex_count += int(model->nodes.size());
+        }
+        vertices.resize(vertex_count);
+
+#pragma omp parallel
+        {
+            // 顶点处理 , 模型之间不需要同步
+            for (int m = 0; m < int(draws.size()); ++m) {
+                std::visit([&](auto* shader) { processModel(*draws[m].first, *shader, draws[m].second, vertex_begin[m]); }, shaders[m]);
+            }
+#pragma omp barrier
+#pragma omp single
+            {
+                // 图元装配
+                for (int m = 0; m < int(draws.size()); ++m) {
+                    assembleModel(*draws[m].first, vertex_begin[m]);
+                    model_end.push_back(int(triangles.size()));
                 }
-                drawTriangle(model->shader, data);
+                binTriangles();
             }
+
+            // 光栅化
+#pragma omp for schedule(dynamic)
+            for (int tile = 0; tile < tiles_x * tiles_y; ++tile) drawTile(tile);
         }
     }
 
 private:
-    // target为要渲染的模型, data[i]为三角形顶点信息: (position, texCoord, color)
-    void drawTriangle(const std::shared_ptr<IShader>& shader, const std::array<VertexData, 3>& data) {
-        // 检查是否所有点都在[-1,1]外
-        bool all_out = true;
-        for (auto& one : data) {
-            auto tmp = screen_mat_inv * one.position;
-            auto min = tmp.v_min(), max = tmp.v_max();
-            all_out = all_out && (min < -1 || max > 1);
+    // 齐次坐标在视锥各个平面外的标记 : 左,右,下,上,近,远
+    int outCode(const Vec4& p) const {
+        number w = p.w();
+        return int(p.x() < 0) | int(p.x() > number(vw) * w) << 1 |
+               int(p.y() < 0) << 2 | int(p.y() > number(vh) * w) << 3 |
+               int(w < w_near) << 4 | int(w > w_far) << 5;
+    }
+
+    // 模型的包围盒是否与视锥相交 , 8个角点都在同一平面外时不相交 , 没有顶点的模型不绘制
+    bool inFrustum(const Model& model, const Mat44& trans_mat) const {
+        const auto& box = model.box;
+        if (box.empty()) return false;
+        int code = ~0;
+        for (int k = 0; k < 8; ++k) {
+            Vec3 corner = make_vec(k & 1 ? box.max.x() : box.min.x(),
+                                   k & 2 ? box.max.y() : box.min.y(),
+                                   k & 4 ? box.max.z() : box.min.z());
+            code &= outCode(trans_mat * corner.as<4>());
         }
-        //if (all_out) return; // Todo 过滤
-
-        // 缓存颜色
-        std::array<Color, 3> colors{data[0].color, data[1].color, data[2].color};
-        // 缓存颜色分量
-        Vec3 red{colors[0].r, colors[1].r, colors[2].r};
-        Vec3 green{colors[0].g, colors[1].g, colors[2].g};
-        Vec3 blue{colors[0].b, colors[1].b, colors[2].b};
-        // 缓存abc
-        Vec3 a = data[0].position, b = data[1].position, c = data[2].position;
-        Vec3 rawA = trans_mat_inv * a, rawB = trans_mat_inv * b, rawC = trans_mat_inv * c;
-        // 获取abc平面的法向量
-        Vec3 norm = (b - a).cross(c - a).normalize();
-        // 缓存xy分量
-        Vec2 a2 = a.as<2>(), b2 = b.as<2>(), c2 = c.as<2>();
-        // 缓存深度信息,参与插值
-        Vec3 z3 = make_vec(a.z(), b.z(), c.z());
-        // 缓存纹理坐标
-        Vec2 texes[] = {data[0].texCoord, data[1].texCoord, data[2].texCoord};
-        Vec3 u3      = make_vec(texes[0].x(), texes[1].x(), texes[2].x());
-        Vec3 v3      = make_vec(texes[0].y(), texes[1].y(), texes[2].y());
-        // 获取i方向边界
-        auto x_min = std::max((int) make_vec(a.x(), b.x(), c.x()).v_min(), 0);
-        auto x_max = std::min((int) make_vec(a.x(), b.x(), c.x()).v_max(), vw - 1);
-
-#pragma omp parallel for
-        // Todo 阴影
-        for (int x = x_min; x <= x_max; ++x) {
-            // 获取紧致的左右边界
-            auto [y_min, y_max] = getTriangleBound(a2, b2, c2, number(x));
-            auto l = std::max(0, (int) y_min), r = std::min(vh - 1, (int) y_max);
-            // Todo 反锯齿
-            while (l <= r && !inTriangle(make_vec(x, l), a2, b2, c2)) ++l;
-            while (l <= r && !inTriangle(make_vec(x, r), a2, b2, c2)) --r;
-            // 填充[l,r]区间
-            for (int y = l; y <= r; ++y) {
-                // 遍历屏幕空间中的点
-                Vec3 rawPoint = make_vec(x, y, 0);
-                // 获取z轴信息
-                rawPoint = intersect(a, norm, make_vec(0, 0, 1), rawPoint);
-
-                // Todo 修复逆变换后缺面的bug
-                // 变换到局部空间
-                //rawPoint = trans_mat_inv * rawPoint;
-                // 进行逆变换再求重心坐标
-                //Vec3 gPos = getGravityPos(rawA, rawB, rawC, rawPoint);
-                Vec3 gPos = getGravityPos(a2, b2, c2, rawPoint.as<2>());
-                // 映射回屏幕空间
-                //rawPoint = trans_mat * rawPoint;
-
-                // 着色器的输入变量,根据重心坐标进行插值
-                number dep = gPos * z3;                      // 深度
-                Vec2   tex = make_vec(gPos * u3, gPos * v3); // 纹理坐标
-                // 着色器的输出变量
-                Color color{};         // 像素颜色
-                bool  discard = false; // 是否弃用
+        return code == 0;
+    }
 
-                // 将uv坐标约束到[0,1]范围内
-                for (int t = 0; t < 2; ++t) tex[t] = MathUtils::clamp(0_n, tex[t], 1_n);
-                // 执行片元着色器
-                shader->fragment(rawPoint, tex, color, discard);
-                if (discard) {
-                    Vec3 vecColor = make_vec(gPos * red, gPos * green, gPos * blue);
-                    color         = {vecColor.x(), vecColor.y(), vecColor.z()};
-                }
-                // 设置像素(并执行深度检测)
-                setPixel(x, y, color, dep);
-            }
+    // 为模型去重后的每个顶点执行顶点着色器 , 写入vertices[begin,...) , S为着色器的具体类型
+    // 在并行区域内由所有线程调用 , 顶点在线程之间划分
+    template<class S>
+    void processModel(const Model& model, S& shader, const Mat44& trans_mat, int begin) {
+#pragma omp for schedule(static) nowait
+        for (int i = 0; i < int(model.nodes.size()); ++i) {
+            auto& node = model.nodes[i];
+            auto& drf  = vertices[begin + i];
+            drf        = {model.vertices[node.pos].as<4>(), model.textures[node.tex]};
+            shader.vertex(drf.position, drf.texCoord, trans_mat, drf.color);
         }
     }
 
-    void setPixel(int x, int y, const Color& fill, number z) {
-#ifndef NDEBUG
-        if (image->invalid(x, y)) throw std::out_of_range("RsRender::setPixel");
-#endif
-        auto& ref = depth[x * vh + y];
-        if (ref > z) {
-            image->setPixel(x, y, fill), ref = z;
+    // 按索引从顶点缓存中取出模型的三角形进行装配
+    void assembleModel(const Model& model, int begin) {
+        for (auto& index : model.indices) {
+            assemble({vertices[begin + index[0]], vertices[begin + index[1]], vertices[begin + index[2]]});
         }
     }
 
-private:
-    // p是否在abc构成的三角形中
-    static bool inTriangle(const Vec2 p, const Vec2& a, const Vec2& b, const Vec2& c) {
-        // 检查p和ab,bc,ca的叉积是否同号
-        number mut[] = {
-            (p - a).cdot(b - a),
-            (p - b).cdot(c - b),
-            (p - c).cdot(a - c)};
-        return (mut[0] >= 0 && mut[1] >= 0 && mut[2] >= 0) || (mut[0] <= 0 && mut[1] <= 0 && mut[2] <= 0);
+    // 图元装配 : 剔除视锥外的三角形 , 用近平面和保护带裁剪后做透视除法
+    void assemble(const std::array<VertexData, 3>& data) {
+        int code[3];
+        for (int i = 0; i < 3; ++i) code[i] = outCode(data[i].position);
+        // 三个顶点都在同一平面外
+        if (code[0] & code[1] & code[2]) return;
+
+        // 每个裁剪平面最多使凸多边形增加一个顶点
+        VertexData poly[9];
+        std::copy(data.begin(), data.end(), poly);
+        int clip  = clipCode(data[0].position) | clipCode(data[1].position) | clipCode(data[2].position);
+        int count = clip ? clipPolygon(poly, 3, clip) : 3;
+        for (int i = 0; i < count; ++i) {
+            auto& pos = poly[i].position;
+            number w  = pos.w();
+            pos       = make_vec(pos.x() / w, pos.y() / w, pos.z() / w, w);
+        }
+        // 多边形按扇形拆分为三角形
+        for (int i = 2; i < count; ++i) triangles.push_back({poly[0], poly[i - 1], poly[i]});
     }
 
-    // 获取重心坐标
-    static Vec3 getGravityPos(const Vec3& a, const Vec3& b, const Vec3& c, const Vec3& p) {
-        decltype(auto) area = [](const Vec3& v1, const Vec3& v2, const Vec3& v3) {
-            return (v1 - v3).cross(v2 - v3).length() / 2;
-        };
-        number s1 = area(b, c, p), s2 = area(a, b, p), s3 = area(a, b, p);
-        number s = s1 + s2 + s3;
-        return {s1 / s, s2 / s, s3 / s};
+    static constexpr int clip_planes = 5;
+
+    // 齐次坐标到裁剪平面的有向距离 , 非负时在内侧 , 平面依次为近平面和保护带的左,右,下,上
+    number clipDistance(const Vec4& p, int plane) const {
+        number w = p.w();
+        switch (plane) {
+            case 0: return w - w_near;
+            case 1: return p.x() + guard * w;
+            case 2: return (number(vw) + guard) * w - p.x();
+            case 3: return p.y() + guard * w;
+            default: return (number(vh) + guard) * w - p.y();
+        }
     }
 
-    static Vec3 getGravityPos(const Vec2& a, const Vec2& b, const Vec2& c, const Vec2& p) {
-        decltype(auto) maker = [](const Vec2& v1, const Vec2& v2, const Vec2& v3) {
-            return Mat33{
-                {1, v1.x(), v1.y()},
-                {1, v2.x(), v2.y()},
-                {1, v3.x(), v3.y()},
-            };
+    // 在各个裁剪平面外的标记
+    int clipCode(const Vec4& p) const {
+        int code = 0;
+        for (int plane = 0; plane < clip_planes; ++plane) code |= int(clipDistance(p, plane) < 0) << plane;
+        return code;
+    }
+
+    // Sutherland-Hodgman算法 , 依次用clip中标记的平面裁剪多边形 , 返回裁剪后的顶点数
+    // 先裁剪近平面 , 之后的顶点都有w>0 , 保护带平面的裁剪才有意义
+    int clipPolygon(VertexData (&poly)[9], int count, int clip) const {
+        VertexData temp[9];
+        for (int plane = 0; plane < clip_planes && count > 0; ++plane) {
+            if (!(clip >> plane & 1)) continue;
+            int n = 0;
+            for (int i = 0; i < count; ++i) {
+                const auto &cur = poly[i], &next = poly[(i + 1) % count];
+                number      dc = clipDistance(cur.position, plane), dn = clipDistance(next.position, plane);
+                if (dc >= 0) temp[n++] = cur;
+                if ((dc >= 0) != (dn >= 0)) {
+                    // 交点处的属性按齐次坐标线性插值
+                    number t  = dc / (dc - dn);
+                    temp[n++] = {cur.position + (next.position - cur.position) * t,
+                                 cur.texCoord + (next.texCoord - cur.texCoord) * t,
+                                 cur.color * (1 - t) + next.color * t};
+                }
+            }
+            std::copy(temp, temp + n, poly);
+            count = n;
+        }
+        return count;
+    }
+
+    // 三角形设置 , 退化,被剔除或超出定点范围时返回false
+    bool setupTriangle(const std::array<VertexData, 3>& data, TriangleSetup& setup) const {
+        // 顶点吸附到定点坐标 , 保护带裁剪后坐标不会超过max_coord , 这里只排除NaN等异常值
+        int64_t px[3], py[3];
+        for (int i = 0; i < 3; ++i) {
+            const auto& pos = data[i].position;
+            if (!(std::abs(pos.x()) < max_coord && std::abs(pos.y()) < max_coord)) return false;
+            px[i] = std::llround(pos.x() * sub_one), py[i] = std::llround(pos.y() * sub_one);
+        }
+        // 两倍的有向面积 , 为0时三角形退化
+        int64_t area = (px[1] - px[0]) * (py[2] - py[0]) - (py[1] - py[0]) * (px[2] - px[0]);
+        if (area == 0) return false;
+        int64_t sign = area > 0 ? 1 : -1;
+        area *= sign;
+        // 正面在屏幕空间中的有向面积为正
+        if ((cull == Cull::Back && sign < 0) || (cull == Cull::Front && sign > 0)) return false;
+
+        // 边i为顶点i的对边j->k , 统一方向使三角形内部e>0
+        for (int i = 0; i < 3; ++i) {
+            int j = (i + 1) % 3, k = (i + 2) % 3;
+            setup.A[i] = sign * (py[j] - py[k]);
+            setup.B[i] = sign * (px[k] - px[j]);
+            setup.C[i] = sign * (px[j] * py[k] - py[j] * px[k]);
+            // 左上规则 : 恰好落在边上的像素只属于左上边所在的三角形
+            bool top_left = setup.A[i] > 0 || (setup.A[i] == 0 && setup.B[i] < 0);
+            if (!top_left) setup.C[i] -= 1;
+        }
+
+        // 像素范围 , 只包含定点包围盒内的采样点
+        auto floor_px = [](int64_t v) { return int(v >> sub_bits); };
+        auto ceil_px  = [](int64_t v) { return int(-(-v >> sub_bits)); };
+        setup.x0 = std::max(ceil_px(std::min({px[0], px[1], px[2]})), 0);
+        setup.x1 = std::min(floor_px(std::max({px[0], px[1], px[2]})), vw - 1);
+        setup.y0 = std::max(ceil_px(std::min({py[0], py[1], py[2]})), 0);
+        setup.y1 = std::min(floor_px(std::max({py[0], py[1], py[2]})), vh - 1);
+        if (setup.x0 > setup.x1 || setup.y0 > setup.y1) return false;
+        setup.z_min = std::min({data[0].position.z(), data[1].position.z(), data[2].position.z()});
+
+        // 属性的平面方程 , 由重心坐标 l1=e1/area , l2=e2/area 对x,y求导得到
+        setup.ax     = number(px[0]) / sub_one, setup.ay = number(py[0]) / sub_one;
+        number scale = number(sub_one) / number(area);
+        number l1_dx = number(setup.A[1]) * scale, l1_dy = number(setup.B[1]) * scale;
+        number l2_dx = number(setup.A[2]) * scale, l2_dy = number(setup.B[2]) * scale;
+        auto   plane = [&](number f0, number f1, number f2) {
+            return Plane{f0, (f1 - f0) * l1_dx + (f2 - f0) * l2_dx, (f1 - f0) * l1_dy + (f2 - f0) * l2_dy};
         };
+        const auto &a = data[0], &b = data[1], &c = data[2];
+        setup.z = plane(a.position.z(), b.position.z(), c.position.z());
+        setup.u = plane(a.texCoord.x(), b.texCoord.x(), c.texCoord.x());
+        setup.v = plane(a.texCoord.y(), b.texCoord.y(), c.texCoord.y());
+        setup.r = plane(a.color.r, b.color.r, c.color.r);
+        setup.g = plane(a.color.g, b.color.g, c.color.g);
+        setup.b = plane(a.color.b, b.color.b, c.color.b);
+        return true;
+    }
 
-        number s1 = maker(p, b, c).det();
-        number s2 = maker(a, p, c).det();
-        number s3 = maker(a, b, p).det();
-        number s  = s1 + s2 + s3;
-        return {s1 / s, s2 / s, s3 / s};
+    // 三角形设置后按像素范围分到覆盖的分块
+    void binTriangles() {
+        setups.resize(triangles.size());
+        for (int index = 0; index < int(triangles.size()); ++index) {
+            auto& setup = setups[index];
+            if (!setupTriangle(triangles[index], setup)) continue;
+            for (int tx = setup.x0 / tile_size; tx <= setup.x1 / tile_size; ++tx) {
+                for (int ty = setup.y0 / tile_size; ty <= setup.y1 / tile_size; ++ty) bins[ty * tiles_x + tx].push_back(index);
+            }
+        }
     }
 
-    // 获取给定x的情况下的左右边界
-    static std::pair<number, number> getTriangleBound(const Vec2& a, const Vec2& b, const Vec2& c, number x) {
-        // 先按x轴升序排序
-        std::array<Vec2, 3> ps{a, b, c};
-        std::sort(ps.begin(), ps.end(), [](const Vec2& va, const Vec2& vb) { return va.x() < vb.x(); });
-        Vec2 top = ps[0], mid = ps[1], bot = ps[2];
-
-        // 一定和top->bot有交点
-        std::pair<number, number> ret;
-        ret.first = intersect(top, bot, x);
-        // 上方为top->mid,下方为bot->mid
-        ret.second = intersect(x < mid.x() || bot.x() == mid.x() ? top : bot, mid, x);
-        if (ret.first > ret.second) std::swap(ret.first, ret.second);
-        return ret;
+    // 绘制一个分块 , 同一模型的连续三角形只分派一次着色器
+    void drawTile(int tile) {
+        const auto& bin = bins[tile];
+        int         tx = tile % tiles_x, ty = tile / tiles_x;
+        int         x0 = tx * tile_size, x1 = std::min(x0 + tile_size, vw) - 1;
+        int         y0 = ty * tile_size, y1 = std::min(y0 + tile_size, vh) - 1;
+        number&     far = tile_far[tile];
+        for (int k = 0, m = 0, drawn = 0; k < int(bin.size()); ++m) {
+            if (bin[k] >= model_end[m]) continue;
+            int end = k;
+            while (end < int(bin.size()) && bin[end] < model_end[m]) ++end;
+            std::visit([&](auto* shader) {
+                for (int i = k; i < end; ++i) {
+                    // 整个三角形在已绘制的几何体之后
+                    const auto& setup = setups[bin[i]];
+                    if (setup.z_min >= far) continue;
+                    drawTriangle(*shader, setup, x0, x1, y0, y1);
+                    if (++drawn % hiz_period == 0) far = farDepth(x0, x1, y0, y1);
+                }
+            }, shaders[m]);
+            far = farDepth(x0, x1, y0, y1);
+            k   = end;
+        }
     }
 
-    // 获取直线sa->ea与x=x0的交点
-    static number intersect(const Vec2& sa, const Vec2& ea, number x) {
-        // sa + t * (ea - sa) = (x, ?)
-        Vec2 dir = ea - sa;
-        if (dir.x() == 0) return sa.y();
-        number t = (x - sa.x()) / dir.x();
-        return sa.y() + t * dir.y();
+    // [x0,x1]x[y0,y1]内深度的最大值 , y0按span对齐
+    number farDepth(int x0, int x1, int y0, int y1) const {
+        SpanFloat far = -inf;
+        number    rest = -inf;
+        for (int x = x0; x <= x1; ++x) {
+            const number* col = depth.data() + x * stride;
+            int           y   = y0;
+            for (; y + span - 1 <= y1; y += span) far = vmax(far, SpanFloat::load(col + y));
+            for (; y <= y1; ++y) rest = std::max(rest, col[y]);
+        }
+        alignas(32) float lanes[span];
+        far.store(lanes);
+        return std::max(rest, *std::max_element(lanes, lanes + span));
     }
 
-    // 获取直线sa->ea,sb->ed的交点
-    static Vec2 intersect(const Vec2& sa, const Vec2& ea, const Vec2& sb, const Vec2& eb) {
-        // sa + t1 * v = sb + t2 * w
-        // P=sa , v = (ea-sa).normalize()
-        // Q=sb , w = (eb-sb).normalize()
-        // u = P - Q
-        // t1 = cross(w,u)/cross(v,w)
-        // t2 = cross(v,u)/cross(v,w)
-        Vec2   v = (ea - sa).normalize(), w = (eb - sb).normalize(), u = sa - sb;
-        number t1 = w.cdot(u) / v.cdot(w);
-        return sa + t1 * v;
+    // 边函数e+k*step>=0的k的范围 , 与[lo,hi]求交 , 为空时hi<lo
+    static void edgeRange(int64_t e, int64_t step, int& lo, int& hi) {
+        if (step > 0) {
+            if (e < 0) lo = int(std::min<int64_t>((-e + step - 1) / step, hi + 1));
+        } else if (e < 0) {
+            hi = -1;
+        } else if (step < 0) {
+            hi = int(std::min<int64_t>(e / -step, hi));
+        }
     }
 
-    // 获取(r-p)n=0平面与直线r=tv+s
-    // p为平面上一点,n为平面法线,v为直线方向向量,s为直线上一点
-    static Vec3 intersect(
-        const Vec3& facePoint, const Vec3& faceNorm,
-        const Vec3& lineDir, const Vec3& linePoint) {
-        Ray    ray  = {linePoint, lineDir};
-        number tick = ray.flat(facePoint, faceNorm);
-        return ray.at(tick);
+    // shader为模型的着色器, setup为三角形设置 , 只绘制[x0,x1]x[y0,y1]内的像素
+    template<class S>
+    void drawTriangle(S& shader, const TriangleSetup& setup, int x0, int x1, int y0, int y1) {
+        // 片元只使用插值颜色时 , 着色在SIMD通道中完成
+        constexpr bool vertex_color = std::is_same_v<S, ShaderVertex>;
+
+        x0 = std::max(x0, setup.x0), x1 = std::min(x1, setup.x1);
+        y0 = std::max(y0, setup.y0), y1 = std::min(y1, setup.y1);
+        // 通道偏移
+        alignas(32) float offset[span];
+        for (int lane = 0; lane < span; ++lane) offset[lane] = float(lane);
+        SpanFloat lanes = SpanFloat::load(offset);
+
+        // Todo 阴影
+        for (int x = x0; x <= x1; ++x) {
+            // 列内被覆盖的像素为y0+[lo,hi]
+            int lo = 0, hi = y1 - y0;
+            for (int i = 0; i < 3 && lo <= hi; ++i) {
+                int64_t e = setup.A[i] * (x * sub_one) + setup.B[i] * (y0 * sub_one) + setup.C[i];
+                edgeRange(e, setup.B[i] * sub_one, lo, hi);
+            }
+            if (lo > hi) continue;
+            lo += y0, hi += y0;
+
+            // 属性在列上的平面方程 : f(y) = base + dy * y
+            number    ox   = number(x) - setup.ax;
+            auto      base = [&](const Plane& p) { return SpanFloat(p.value + p.dx * ox - p.dy * setup.ay); };
+            SpanFloat z0 = base(setup.z), u0 = base(setup.u), v0 = base(setup.v);
+            SpanFloat r0 = base(setup.r), g0 = base(setup.g), b0 = base(setup.b);
+            SpanFloat low = number(lo), high = number(hi);
+
+            // Todo 反锯齿
+            for (int ys = lo / span * span; ys <= hi; ys += span) {
+                SpanFloat py   = SpanFloat(number(ys)) + lanes;
+                SpanMask  mask = (py >= low) & (py <= high);
+                SpanFloat dep  = z0 + SpanFloat(setup.z.dy) * py;
+
+                // 提前深度检测 , 片元着色器只作用于通过的通道
+                number*   ref  = depth.data() + x * stride + ys;
+                SpanFloat old  = SpanFloat::load(ref);
+                SpanMask  pass = mask & (dep < old);
+                if (pass.none()) continue;
+                select(pass, dep, old).store(ref);
+
+                // 插值颜色
+                alignas(32) float red[span], green[span], blue[span];
+                (r0 + SpanFloat(setup.r.dy) * py).store(red);
+                (g0 + SpanFloat(setup.g.dy) * py).store(green);
+                (b0 + SpanFloat(setup.b.dy) * py).store(blue);
+                // 将uv坐标约束到[0,1]范围内
+                alignas(32) float zs[span], us[span], vs[span];
+                if constexpr (!vertex_color) {
+                    SpanFloat zero = 0.f, one = 1.f;
+                    dep.store(zs);
+                    vmin(vmax(u0 + SpanFloat(setup.u.dy) * py, zero), one).store(us);
+                    vmin(vmax(v0 + SpanFloat(setup.v.dy) * py, zero), one).store(vs);
+                }
+
+                int bits = pass.movemask();
+                for (int lane = 0; lane < span; ++lane) {
+                    if (!(bits >> lane & 1)) continue;
+                    // 着色器的输出变量
+                    Color color{red[lane], green[lane], blue[lane]}; // 像素颜色
+                    if constexpr (!vertex_color) {
+                        bool discard = false; // 是否弃用 , 弃用时使用插值颜色
+                        // 执行片元着色器
+                        Color frag{};
+                        shader.fragment(make_vec(number(x), number(ys + lane), zs[lane]),
+                                        make_vec(us[lane], vs[lane]), frag, discard);
+                        if (!discard) color = frag;
+                    }
+                    image->setPixel(x, ys + lane, color);
+                }
+            }
+        }
     }
 };
 
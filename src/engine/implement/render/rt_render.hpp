@@ -6,52 +6,160 @@
 #define MINI_ENGINE_RT_RENDER_HPP
 
 #include "interface/render.hpp"
+#include "accelerator/compiled_scene.hpp"
+#include "math/distribution.hpp"
 #include "tools/process.hpp"
 
 namespace mne {
 // 基于光线追踪的渲染器
 class RtRender: public IRender {
     Process<true> process;
+    TileScheduler scheduler;
+
+    CompiledScene compiled; // 按图元类型组织的场景 , 负责求交和材质的分派
+
+    AliasTable                  light_table;     // 按辐射功率选择光源
+    std::vector<const IObject*> lights;          // 光源集合
+    std::vector<MaterialBaked>  light_materials; // 光源的材质
+    std::vector<number>         light_pdf;       // 在光源表面采样一个点的pdf(对面积)
 
 public:
     void render() final {
+        // 构建加速结构
+        buildAccelerator();
+        // 构建光源分布
+        buildLights();
         // 初始化输出缓冲区
         auto [vw, vh] = camera->getWH(); // 视口大小
         image->resize(vw, vh);
         // 初始化进度
         process.init(vw * vh, vh * 10);
 
-        // 枚举每个像素
-#pragma omp parallel for
-        for (int x = 0; x < vw; x++) {
-#pragma omp parallel for
-            for (int y = 0; y < vh; y++) {
-                image->setPixel(x, y, samplePixel(number(x), number(y)));
-                process.update();
+        // 按图块并行渲染 , 每行相邻的packet_width个像素组成一个光线包
+        scheduler.run(vw, vh, [this](const Tile& tile) {
+            for (int y = tile.y0; y < tile.y1; y++) {
+                for (int x = tile.x0; x < tile.x1; x += packet_width) {
+                    int   count = std::min(packet_width, tile.x1 - x);
+                    Color colors[packet_width];
+                    samplePixels(x, y, count, colors);
+                    for (int i = 0; i < count; ++i) image->setPixel(x + i, y, colors[i]);
+                }
             }
-        }
+            notifyTile(tile);
+        });
     }
 
+    RtRender() {
+        // 进度按完成的图块更新
+        subscribe([this](const Tile& tile) { process.update(tile.area()); });
+    }
+
+    // 图块边长
+    void setTileSize(int size) { scheduler.tile_size = size; }
+
     std::shared_ptr<RtCamera> camera2;
 
+    int max_depth = 10; // 路径的最大弹射次数
+    int rr_depth  = 3;  // 从第几次弹射开始进行俄罗斯轮盘赌
+
+    BVH::Method builder = BVH::Method::SAH; // 场景BVH的构建方式
+
 private:
-    // 计算单个像素信息
-    Color samplePixel(number x, number y) {
-        Color     sum{};
-        HitResult hit;
+    // 一条路径的状态
+    struct PathState {
+        Color      L{};                  // 累计的辐射
+        Color      beta{1_n, 1_n, 1_n}; // 路径的吞吐量
+        HitResult  cur, next;            // 当前和下一个观测点
+        Vec3       dir;                  // 当前入射方向
+        BxDFResult bxdf;                 // 当前观测点的BxDF采样
+        int        depth = 0;            // 弹射次数
+    };
+
+    // 直接光照的光源采样 , 与遮挡检测分开以便成组检测
+    struct LightSample {
+        int         index{}; // 选中的光源
+        LightResult ems;     // 光源上的采样点
+        Vec3        l_out;   // 观测点指向采样点的矢量
+    };
+
+    /**
+     * @brief 计算同一行中相邻像素的颜色
+     * 主光线和首次弹射的阴影射线以光线包求交 , 之后的弹射逐条路径进行
+     * 每条路径消耗的随机数与逐像素计算时相同 , 结果不受包宽度影响
+     * @param x,y 首个像素
+     * @param count 像素数量 , 不超过packet_width
+     * @param colors 输出的颜色
+     */
+    void samplePixels(int x, int y, int count, Color* colors) const {
+        PacketMask active = PacketMask::fromBits((1u << count) - 1u);
+        uint64_t   pixel  = uint64_t(y) * image->getWidth() + x;
+
+        Color               sum[packet_width]{};
+        PathState           paths[packet_width];
+        LightSample         samples[packet_width];
+        RandomUtils::Stream streams[packet_width];
         for (int k = 0; k < spp; ++k) {
-            // 在[x,x+1)x[y,y+1)内随机采样
-            auto [ox, oy] = sampleArea();
-            number sx = x + ox, sy = y + oy;
-            auto   ray = camera->makeRay(sx, sy);
-            // 检查和场景的碰撞
-            if (intersect(ray, hit)) {
-                sum += trace(ray.dir, hit);
-            } else {
-                sum += background;
+            /// 主光线 ---------------------------
+            float sx[packet_width], sy[packet_width];
+            for (int i = 0; i < packet_width; ++i) {
+                sx[i] = float(x + std::min(i, count - 1)), sy[i] = float(y);
+                if (i >= count) continue;
+                // 每个样本使用由(像素,样本)决定的随机数序列
+                RandomUtils::seed(pixel + i, k);
+                // 在[x,x+1)x[y,y+1)内随机采样
+                auto [ox, oy] = sampleArea();
+                sx[i] += ox, sy[i] += oy;
+                streams[i] = RandomUtils::save();
+            }
+            RayPacket primary = camera->makeRays(PacketFloat::load(sx), PacketFloat::load(sy));
+            PacketHit hit;
+            int       found = intersect(primary, hit, active).movemask();
+
+            /// 首次弹射的BxDF和光源采样 ----------
+            Ray      shadow[packet_width];
+            float    shadow_tmax[packet_width]{};
+            uint32_t alive = 0, lit = 0; // 继续弹射的通道 , 需要检测阴影的通道
+            for (int i = 0; i < count; ++i) {
+                auto& s = paths[i];
+                s       = {};
+                if (!(found >> i & 1) || !hit.get(i, s.cur)) {
+                    sum[i] += background;
+                    continue;
+                }
+                // 只为最近的碰撞计算表面信息
+                Ray ray = primary.ray(i);
+                compiled.computeSurfaceInteraction(ray, s.cur);
+                s.dir = ray.dir;
+
+                RandomUtils::restore(streams[i]);
+                if (!scatter(s)) {
+                    sum[i] += s.L;
+                    continue;
+                }
+                if (!s.bxdf.specular && sampleLight(s.cur, samples[i])) {
+                    shadow[i]      = shadowRay(s.cur, samples[i]);
+                    shadow_tmax[i] = shadowRange(samples[i]);
+                    lit |= 1u << i;
+                }
+                alive |= 1u << i, streams[i] = RandomUtils::save();
+            }
+
+            /// 阴影射线 --------------------------
+            if (lit) lit &= ~occluded(RayPacket::fromRays(shadow, count), shadow_tmax, PacketMask::fromBits(lit)).movemask();
+
+            /// 剩余的弹射 ------------------------
+            for (int i = 0; i < count; ++i) {
+                if (!(alive >> i & 1)) continue;
+                auto& s = paths[i];
+                RandomUtils::restore(streams[i]);
+                if (lit >> i & 1) {
+                    s.L += s.beta * directLight(s.cur, s.bxdf, samples[i]);
+                }
+                if (advance(s)) trace(s);
+                sum[i] += s.L;
             }
         }
-        return sum / number(spp);
+        for (int i = 0; i < count; ++i) colors[i] = sum[i] / number(spp);
     }
 
     // 在[0,1)x[0,1)中随机采样一个点
@@ -60,102 +168,164 @@ private:
     }
 
 private:
+    // 阴影射线的相对收缩量
+    static constexpr number shadow_eps = 1e-4_n;
+
     // 背景色/环境光
     Color background = Color::fromRGB256(255, 255, 255) * 0.3_n;
 
-    // Todo 转循环
-    // 以in_dir方向的射线打到hit上的全局光照信息
-    Color trace(const Vec3& in_dir, const HitResult& hit, int depth = 0) const {
-        /// 配置 -----------------------------
-        constexpr int max_dep = 10; // 深度限制
+    // 从s.cur开始追踪路径 , 直到路径终止
+    void trace(PathState& s) const {
+        while (scatter(s)) {
+            /// 直接光照 , 镜面材质只需要间接光照 ----
+            LightSample sample;
+            if (!s.bxdf.specular && sampleLight(s.cur, sample) && visible(s.cur, sample)) {
+                s.L += s.beta * directLight(s.cur, s.bxdf, sample);
+            }
+            if (!advance(s)) break;
+        }
+    }
 
-        /// 简写 -----------------------------
-        auto& obj = *(hit.obj);   // 观测点所在的图元
-        auto& mat = obj.matRef(); // 观测点的材质
+    // 处理观测点的终止条件并采样BxDF , 返回路径是否继续
+    bool scatter(PathState& s) const {
+        // 编译过的物体使用静态分派的材质
+        const MaterialBaked* baked = compiled.material(s.cur);
+        return baked ? scatter(s, *baked) : scatter(s, s.cur.obj->matRef());
+    }
 
-        /// 递归终止条件 ----------------------
-        if (obj.isLight()) return mat.emit(hit.uv).clamp(1_n); // 直接观测到光源
-        if (depth > max_dep) return Color{0, 0, 0};            // 超过最大深度
+    // M为观测点的材质类型 , MaterialBaked或IMaterial
+    template<class M>
+    bool scatter(PathState& s, const M& mat) const {
+        /// 终止条件 --------------------------
+        if (mat.isLight()) { // 直接观测到光源 , 或经镜面反射观测到光源
+            s.L += s.beta * mat.emit(s.cur.uv).clamp(1_n);
+            return false;
+        }
+        if (s.depth > max_depth) return false; // 超过最大深度
 
         /// BxDF信息 -------------------------
-        BxDFResult bxdf;
-        mat.sample(in_dir, hit, bxdf);
+        mat.sample(s.dir, s.cur, s.bxdf);
+        return s.bxdf.pdf > 0_n;
+    }
 
-        /// 间接光照 --------------------------
-        Color     L_indirect{}, le{};
-        HitResult hit2;
-        if (intersect(Ray{hit.point, bxdf.out_dir}, hit2) && (bxdf.specular || !hit2.obj->isLight())) {
-            le = trace(bxdf.out_dir, hit2, depth + 1);
-        } else if (!hit2.success) {
-            le = background;
+    // 更新吞吐量并寻找下一个观测点 , 返回路径是否继续
+    bool advance(PathState& s) const {
+        auto& bxdf = s.bxdf;
+
+        /// 更新吞吐量 ------------------------
+        number dot = s.cur.normal * bxdf.out_dir; // 与观测点夹角
+        s.beta     = s.beta * bxdf.albedo * (dot / bxdf.pdf);
+
+        /// 俄罗斯轮盘赌 ----------------------
+        if (s.depth >= rr_depth) {
+            number p_rr = std::min(s.beta.v_max(), 0.95_n);
+            if (!RandomUtils::randBool(p_rr)) return false;
+            s.beta /= p_rr;
         }
-        {
-            Color  f_r = bxdf.albedo;               // 反射率
-            number pdf = bxdf.pdf;                  // 采样的pdf
-            number dot = hit.normal * bxdf.out_dir; // 与观测点夹角
 
-            L_indirect = (le * f_r) * (dot / (pdf)); // * p_rr
+        /// 间接光照 --------------------------
+        if (!intersect(Ray{s.cur.point, bxdf.out_dir}, s.next)) {
+            s.L += s.beta * background;
+            return false;
         }
-        //  镜面材质只需要间接光照
-        if (bxdf.specular) return L_indirect;
+        // 漫反射路径上的光源已经计入直接光照
+        if (!bxdf.specular && s.next.obj->isLight()) return false;
+
+        std::swap(s.cur, s.next), s.dir = bxdf.out_dir, ++s.depth;
+        return true;
+    }
 
-        /// 直接光照 --------------------------
-        Color L_direct{};
-        auto& light = selectLight(); // 随机选择一个光源
+    // 随机选择一个光源并在其表面采样 , 没有光源时返回false
+    bool sampleLight(const HitResult& hit, LightSample& sample) const {
+        if (light_table.empty()) return false;
+        sample.index = light_table.sample(RandomUtils::randFloat()); // 随机选择一个光源
+        sample.ems   = {};
+        lights[sample.index]->sampleLight(sample.ems);              // 随机采样
+        sample.l_out = (sample.ems.point - hit.point).cast<number>(); // 光线矢量
+        return true;
+    }
 
-        LightResult ems; // 随机采样
-        light.sampleLight(ems);
+    // 观测点和光源采样点之间是否没有遮挡
+    bool visible(const HitResult& hit, const LightSample& sample) const {
+        return !occluded(shadowRay(hit, sample), shadowRange(sample));
+    }
 
-        auto l_out     = ems.point - hit.point; // 光线矢量
-        auto l_out_dir = l_out.normalize();     // 光线方向
+    // 从观测点指向光源采样点的阴影射线
+    static Ray shadowRay(const HitResult& hit, const LightSample& sample) {
+        return Ray{hit.point, sample.l_out.normalize()};
+    }
 
-        // 检测是否被遮挡
-        if (intersect(Ray{hit.point, l_out_dir}, hit2) && hit2.obj == &light) {
-            Color  f_r_l = bxdf.albedo;                              // 反射率
-            number pdf_l = lightPDF();                               // 光源采样的pdf, light.PDF();
-            number dot   = hit.normal * l_out_dir;                   // 与观测点夹角
-            number dot_l = std::max(0_n, -(ems.normal * l_out_dir)); // 与光源夹角
-            Color  le_l  = light.matRef().emit(ems.uv);              // 直接光照
+    // 阴影射线的检测范围 , 略短于到采样点的距离 , 避免光源自身被视为遮挡物
+    static number shadowRange(const LightSample& sample) {
+        return sample.l_out.length() * (1_n - shadow_eps);
+    }
 
-            L_direct = (le_l * f_r_l) * (dot * dot_l / (pdf_l * l_out.norm2()));
-        }
+    // 未被遮挡的光源采样点对观测点的直接光照
+    Color directLight(const HitResult& hit, const BxDFResult& bxdf, const LightSample& sample) const {
+        auto& ems       = sample.ems;
+        auto  l_out_dir = sample.l_out.normalize(); // 光线方向
 
-        /// 返回结果 --------------------------
-        return (L_direct + L_indirect);
+        Color  f_r_l = bxdf.albedo;                                // 反射率
+        number pdf_l = light_pdf[sample.index] * ems.pdf_scale;    // 光源采样的pdf
+        number dot   = hit.normal * l_out_dir;                     // 与观测点夹角
+        number dot_l = std::max(0_n, -(ems.normal * l_out_dir));   // 与光源夹角
+        Color  le_l  = light_materials[sample.index].emit(ems.uv); // 直接光照
+
+        return (le_l * f_r_l) * (dot * dot_l / (pdf_l * sample.l_out.norm2()));
     }
 
 private:
     // 辅助函数
 
-    // Todo 使用BVH优化
+    // 编译场景并构建BVH , 物体不变时(如动画的下一帧)只refit
+    void buildAccelerator() {
+        compiled.build(scene->objects, builder);
+    }
+
     // 射线检测
     bool intersect(const Ray& ray, HitResult& hit) const {
-        HitResult temp;
         hit.reset();
-        for (const auto& ptr : scene->objects) {
-            if (ptr->intersect(ray, temp)) {
-                hit = temp;
-            }
-        }
-        return hit.success;
+        bool found = compiled.intersect(ray, hit);
+        // 只为最近的碰撞计算表面信息
+        if (found) compiled.computeSurfaceInteraction(ray, hit);
+        return hit.success = found;
     }
 
-    // 按面积比决定概率比然后选择光源
-    const IObject& selectLight() const {
-        std::vector<number> areas;
-        for (auto& ptr : scene->objects) areas.push_back(ptr->isLight() ? ptr->area() : 0_n);
-        return *(scene->objects[RandomUtils::randChoose(areas)]);
+    // 射线在(min_tick,t_max)内是否被遮挡 , 找到任意遮挡物即返回
+    bool occluded(const Ray& ray, number t_max) const {
+        HitResult range;
+        range.clip(t_max);
+        return compiled.occluded(ray, range);
     }
 
-    // 返回光源采样的pdf
-    number lightPDF() const {
-        number areaSum = 0_n;
+    // 光线包版本 , 返回被遮挡的通道
+    PacketMask occluded(const RayPacket& packet, const float* t_max, PacketMask active) const {
+        PacketHit range;
+        range.t_max = PacketFloat::load(t_max);
+        return compiled.occluded(packet, range, active);
+    }
+
+    // 光线包检测 , 返回有碰撞的通道 , 表面信息需要按通道单独计算
+    PacketMask intersect(const RayPacket& packet, PacketHit& hit, PacketMask active) const {
+        return compiled.intersect(packet, hit, active);
+    }
+
+    // 按辐射功率(辐射强度x面积)构建光源的别名表
+    void buildLights() {
+        std::vector<number> weights;
+        lights.clear(), light_materials.clear(), light_pdf.clear();
         for (auto& ptr : scene->objects) {
-            if (ptr->isLight()) {
-                areaSum += ptr->area();
-            }
+            number area = ptr->area();
+            if (!ptr->isLight() || area <= 0_n) continue;
+            Color emit = ptr->matRef().emit({0.5_n, 0.5_n});
+            lights.push_back(ptr.get()), light_materials.emplace_back(ptr->matRef());
+            weights.push_back((emit.r + emit.g + emit.b) / 3_n * area);
+        }
+        light_table.build(weights);
+        // 选中光源的概率 / 光源面积
+        for (int i = 0; i < light_table.size(); ++i) {
+            light_pdf.push_back(light_table.probability(i) / lights[i]->area());
         }
-        return 1_n / areaSum;
     }
 };
 
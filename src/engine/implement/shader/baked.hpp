@@ -0,0 +1,25 @@
+﻿//
+// Created by IMEI on 2022/9/15.
+//
+
+#ifndef MINI_ENGINE_SHADER_BAKED_HPP
+#define MINI_ENGINE_SHADER_BAKED_HPP
+
+#include <variant>
+
+#include "simple.hpp"
+
+namespace mne {
+
+// 静态分派的着色器 , 用std::visit在模型级别分派一次 , 逐片元的调用不经过虚函数
+using ShaderBaked = std::variant<IShader*, ShaderTexture*, ShaderVertex*>;
+
+inline ShaderBaked bakeShader(IShader* shader) {
+    if (auto* texture = dynamic_cast<ShaderTexture*>(shader)) return texture;
+    if (auto* vertex = dynamic_cast<ShaderVertex*>(shader)) return vertex;
+    return shader;
+}
+
+} // namespace mne
+
+#endif //MINI_ENGINE_SHADER_BAKED_HPP
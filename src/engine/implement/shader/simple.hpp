@@ -7,22 +7,26 @@
 
 #include "interface/shader.hpp"
 #include "store/model.hpp"
+#include "implement/texture/baked.hpp"
 
 namespace mne {
 
 // 极简shader实现
 
 // 映射纹理信息
-class ShaderTexture: public IShader {
-    Model& model;
+class ShaderTexture final: public IShader {
+    Model&       model;
+    TextureBaked texture; // 模型的颜色纹理 , 静态分派
 
 public:
     ShaderTexture(Model& model):
         model(model) {
     }
 
+    void bind() final { texture = model.colorTexture.get(); }
+
     void vertex(
-        Vec3&        gl_Position,
+        Vec4&        gl_Position,
         const Vec2&  gl_TexCoord,
         const Mat44& gl_Transform,
         Color&       gl_Color) final {
@@ -33,15 +37,15 @@ public:
         const Vec2& gl_TexCoord,
         Color&      gl_FragColor,
         bool&       gl_Discard) final {
-        gl_FragColor = model.colorTexture->value(gl_TexCoord);
+        gl_FragColor = texture.value(gl_TexCoord);
     }
 };
 
 // 插值顶点信息
-class ShaderVertex: public IShader {
+class ShaderVertex final: public IShader {
 public:
     void vertex(
-        Vec3&        gl_Position,
+        Vec4&        gl_Position,
         const Vec2&  gl_TexCoord,
         const Mat44& gl_Transform,
         Color&       gl_Color) final {
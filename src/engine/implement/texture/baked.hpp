@@ -0,0 +1,45 @@
+﻿//
+// Created by IMEI on 2022/9/15.
+//
+
+#ifndef MINI_ENGINE_TEXTURE_BAKED_HPP
+#define MINI_ENGINE_TEXTURE_BAKED_HPP
+
+#include <variant>
+
+#include "solid.hpp"
+#include "mapping.hpp"
+
+namespace mne {
+
+// 静态分派的纹理 , 已知类型按值或具体类型保存 , 调用可以内联 , 其他类型仍通过ITexture
+class TextureBaked {
+    std::variant<Color, const TextureImage*, const ITexture*> texture;
+
+public:
+    TextureBaked(const ITexture* ptr = nullptr) {
+        if (auto* solid = dynamic_cast<const TextureSolid*>(ptr)) {
+            texture = solid->emission;
+        } else if (auto* image = dynamic_cast<const TextureImage*>(ptr)) {
+            texture = image;
+        } else {
+            texture = ptr;
+        }
+    }
+
+    // 与ITexture::value相同 , 空纹理为黑色
+    Color value(const Vec2& uv) const {
+        switch (texture.index()) {
+            case 0: return *std::get_if<0>(&texture);
+            case 1: return (*std::get_if<1>(&texture))->value(uv);
+            default: {
+                auto* ptr = *std::get_if<2>(&texture);
+                return ptr ? ptr->value(uv) : Color{};
+            }
+        }
+    }
+};
+
+} // namespace mne
+
+#endif //MINI_ENGINE_TEXTURE_BAKED_HPP
@@ -11,7 +11,7 @@
 namespace mne {
 
 // 将一张图片映射到u,v坐标上
-class TextureImage: public ITexture {
+class TextureImage final: public ITexture {
     Image image;
     int   w{}, h{};
 
@@ -21,7 +21,7 @@ public:
         std::tie(w, h) = image.getWH();
     }
 
-    Color value(const Vec2& uv) const override {
+    Color value(const Vec2& uv) const final {
         return image.getPixel(uv);
     }
 };
@@ -10,14 +10,16 @@
 namespace mne {
 
 // 纯色纹理
-class TextureSolid: public ITexture {
+class TextureSolid final: public ITexture {
+    friend class TextureBaked;
+
     Color emission;
 
 public:
     TextureSolid(const Color& _emission):
         emission(_emission) {}
 
-    Color value(const Vec2& uv) const override {
+    Color value(const Vec2& uv) const final {
         return emission;
     }
 };
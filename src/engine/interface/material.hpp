@@ -22,6 +22,8 @@ struct BxDFResult {
 };
 
 struct IMaterial {
+    friend class MaterialBaked;
+
 protected:
     // 光源的纹理,即内部辐射的能量
     std::shared_ptr<ITexture> emission;
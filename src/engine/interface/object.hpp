@@ -6,6 +6,7 @@
 #define MINI_ENGINE_OBJECT_HPP
 
 #include "data/ray.hpp"
+#include "data/packet.hpp"
 #include "data/transform.hpp"
 #include "data/xyz.hpp"
 #include "accelerator/AABB.hpp"
@@ -15,9 +16,11 @@ namespace mne {
 
 // 光源在某个点周围面积的采样结果
 struct LightResult {
-    Vec3 normal{}; // 表面法线
-    Vec3 point{};  // 采样坐标
+    Vec3  normal{}; // 表面法线
+    Vec3r point{};  // 采样坐标
     Vec2 uv;       // 纹理坐标
+
+    number pdf_scale = 1_n; // 采样点实际的pdf与1/area()之比 , 非均匀缩放的实例上不为1
 };
 
 class IObject {
@@ -31,43 +34,55 @@ protected:
     std::vector<std::shared_ptr<IObject>> children{};
     // 物体自身的坐标系,物体的坐标全都相对此坐标系
     XYZ xyz_p;
-    // 只处理方向的坐标系,o为原点
-    XYZ xyz_d;
-
-    // 点的实际坐标
-    Vec3 pToWorld(Vec3 point) const {
-        auto* cur = this;
-        while (cur) {
-            point = cur->xyz_p.toWorld(point);
-            cur   = cur->parent;
-        }
-        return point;
-    }
+
+private:
+    // 合并了所有祖先变换的仿射矩阵 , 随变换和父子关系的变化沿子树更新 , 按世界空间的精度累积
+    Mat44r to_world = MatUtils::identity<4>().cast<real>(); // 局部坐标 => 世界坐标
+    Mat44r to_local = MatUtils::identity<4>().cast<real>(); // 世界坐标 => 局部坐标
+
+protected:
+    // 点的实际坐标 , 物体参数按number保存
+    Vec3 pToWorld(const Vec3& point) const { return MatUtils::applyPoint(to_world, point).cast<number>(); }
 
     // 向量的实际指向,带长度
-    Vec3 dToWorld(Vec3 dir) const {
-        auto* cur = this;
-        while (cur) {
-            dir = cur->xyz_d.toWorld(dir);
-            cur = cur->parent;
-        }
-        return dir;
+    Vec3 dToWorld(const Vec3& dir) const { return MatUtils::applyDir(to_world, dir).cast<number>(); }
+
+    // 法线的实际指向 , 使用逆矩阵的转置 , 返回单位向量
+    Vec3 nToWorld(const Vec3& normal) const {
+        Vec3 ret;
+        for (int i = 0; i < 3; ++i) ret[i] = number(to_local.col(i).as<3>() * normal);
+        return ret.normalize();
+    }
+
+    const Mat44r& toWorldMat() const { return to_world; }
+    const Mat44r& toLocalMat() const { return to_local; }
+
+    // 子对象或自身的几何变化后 , 沿父节点链刷新包围盒
+    void refreshAABB() {
+        for (auto* cur = this; cur; cur = cur->parent) cur->updateAABB();
     }
 
     // 图元从初始状态经历一个仿射变换
     void setTransform(const Transform& transform) {
-        // 重设两个坐标系
         xyz_p = XYZ(transform);
-        xyz_d = xyz_p.origin();
         updateVec();
     }
 
 private:
-    // 更新位置信息
+    // 更新位置信息 , 每个节点只做一次矩阵乘法和求逆 , 子对象先于自身更新包围盒
     void updateVec() {
+        to_world = parent ? parent->to_world * xyz_p.toMat().cast<real>() : xyz_p.toMat().cast<real>();
+        to_local = to_world.affineInvert();
         onSetTransform();
-        updateAABB();
         for (auto& child : children) child->updateVec();
+        updateAABB();
+    }
+
+    void attach(const std::shared_ptr<IObject>& child) {
+        if (child->parent) child->parent->removeChild(child);
+        child->parent = this; // Todo shared_from_this();
+        child->updateVec();
+        children.push_back(child);
     }
 
     // 更新transform后的回调,更新绝对坐标
@@ -75,14 +90,19 @@ private:
 
 public:
     void addChild(const std::shared_ptr<IObject>& child) {
-        if (child->parent) child->parent->removeChild(child);
-        child->parent = this; // Todo shared_from_this();
-        child->updateVec();
-        children.push_back(child);
+        attach(child);
+        refreshAABB();
+    }
+
+    // 批量添加 , 包围盒只刷新一次
+    void addChild(const std::vector<std::shared_ptr<IObject>>& list) {
+        for (auto& child : list) attach(child);
+        refreshAABB();
     }
 
     void addChild(const std::initializer_list<std::shared_ptr<IObject>>& list) {
-        for (auto& child : list) addChild(child);
+        for (auto& child : list) attach(child);
+        refreshAABB();
     }
 
     void removeChild(const std::shared_ptr<IObject>& child) {
@@ -91,6 +111,7 @@ public:
         children.erase(it);
         child->parent = nullptr;
         child->updateVec();
+        refreshAABB();
     }
 
 protected:
@@ -100,20 +121,48 @@ public:
     void setMaterial(std::shared_ptr<IMaterial> mat) {
         if (!mat) mat = std::make_shared<MaterialDefault>();
         material = mat;
+        onSetMaterial();
     }
 
+private:
+    // 更新材质后的回调
+    virtual void onSetMaterial() {}
+
 public:
     const IMaterial& matRef() const { return *material; }
 
+    const std::shared_ptr<IMaterial>& getMaterial() const { return material; }
+
 public:
     IObject() { setMaterial(nullptr); }
 
 protected:
-    AABB bbox; // 包围盒
+    AABB bbox = AABB::Infinite(); // 包围盒 , 未计算时包含整个空间
 
+    // 在hit的有效区间内求交 , 碰撞时用setTick更新tick , 需要时记录prim和local , 不计算表面信息
     virtual void intersection(const Ray& ray, HitResult& hit) const = 0;
 
-    // Todo 更新包围盒
+    // 射线在hit的有效区间内是否与物体相交 , 默认调用intersection
+    virtual bool occlusion(const Ray& ray, HitResult& hit) const {
+        intersection(ray, hit);
+        return hit.success;
+    }
+
+    // 光线包与物体求交 , 碰撞的通道需要更新hit , 返回碰撞的通道 , 默认逐通道调用intersection
+    virtual PacketMask intersection(const RayPacket& packet, PacketHit& hit, PacketMask active) const {
+        float    t_max[packet_width];
+        uint32_t bits = 0;
+        hit.t_max.store(t_max);
+        for (int lane = 0; lane < packet_width; ++lane) {
+            if (!active[lane]) continue;
+            HitResult temp;
+            temp.clip(t_max[lane]);
+            if (intersect(packet.ray(lane), temp)) hit.set(lane, temp), bits |= 1u << lane;
+        }
+        return PacketMask::fromBits(bits);
+    }
+
+    // 更新包围盒 , 默认包含整个空间
     virtual void updateAABB() {}
 
 public:
@@ -123,16 +172,47 @@ public:
     // 表面积
     virtual number area() const = 0;
 
+    // 世界坐标系下的表面再经过线性变换linear后的面积 , 供几何实例计算非均匀缩放后的面积
+    virtual number area(const Mat33& linear) const = 0;
+
     // 是否为光源
     bool isLight() const { return material->isLight(); }
 
+    // 世界坐标系下的包围盒
+    const AABB& getAABB() const { return bbox; }
+
 public:
-    // 光线和物体的首个交点
+    // 由求交记录的tick,prim和local计算碰撞点的表面信息 , 只对最近的碰撞调用一次
+    virtual void computeSurfaceInteraction(const Ray& ray, HitResult& hit) const {
+        hit.point = hit.getPoint(ray);
+    }
+
+    // 光线和物体的首个交点 , 成功时hit.obj更新为实际碰撞的物体 , 失败时hit保持不变
     bool intersect(const Ray& ray, HitResult& hit) const {
-        hit.success = false;
-        bool ret    = bbox.intersect(ray) && (intersection(ray, hit), hit.success);
-        hit.obj     = ret ? this : nullptr;
-        return ret;
+        if (!bbox.intersect(ray, hit)) return false;
+        const IObject* last = hit.obj;
+        hit.success = false, hit.obj = this;
+        intersection(ray, hit);
+        if (!hit.success) hit.obj = last;
+        return hit.success;
+    }
+
+    // 射线在range的有效区间内是否被物体遮挡
+    bool occluded(const Ray& ray, HitResult range) const {
+        range.success = false;
+        return bbox.intersect(ray, range) && occlusion(ray, range);
+    }
+
+    // 光线包版本 , 返回在各自区间内被遮挡的通道
+    PacketMask occluded(const RayPacket& packet, PacketHit range, PacketMask active) const {
+        active = active & bbox.intersect(packet, range);
+        return active.none() ? active : intersection(packet, range, active);
+    }
+
+    // 光线包和物体的首个交点 , 返回碰撞的通道
+    PacketMask intersect(const RayPacket& packet, PacketHit& hit, PacketMask active) const {
+        active = active & bbox.intersect(packet, hit);
+        return active.none() ? active : intersection(packet, hit, active);
     }
 
     static std::shared_ptr<IObject> load(
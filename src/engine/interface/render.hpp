@@ -8,6 +8,7 @@
 #include "data/camera.hpp"
 #include "data/scene.hpp"
 #include "store/image.hpp"
+#include "tools/scheduler.hpp"
 
 namespace mne {
 // 渲染器接口,输入摄像机+光源+模型信息,输出图片
@@ -26,6 +27,20 @@ public:
 
 public:
     virtual void render() = 0;
+
+public:
+    // 订阅图块完成的事件 , 回调在渲染线程中调用 , 需要自行保证线程安全
+    void subscribe(TileCallback callback) {
+        tile_listeners.push_back(std::move(callback));
+    }
+
+protected:
+    std::vector<TileCallback> tile_listeners;
+
+    // 通知图块已经写入image
+    void notifyTile(const Tile& tile) const {
+        for (auto& listener : tile_listeners) listener(tile);
+    }
 };
 } // namespace mne
 
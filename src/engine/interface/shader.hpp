@@ -13,15 +13,18 @@ namespace mne {
 // 着色器接口
 class IShader {
 public:
+    // 每帧渲染模型前调用 , 可以在此缓存模型的状态
+    virtual void bind() {}
+
     /**
-     * @brief 顶点着色器
-     * @param gl_Position 顶点坐标 . in-out
+     * @brief 顶点着色器 , 同一帧内会被多个线程同时调用
+     * @param gl_Position 顶点坐标 . in-out , 输入为w=1的局部坐标 , 输出为裁剪空间的齐次坐标(不做透视除法)
      * @param gl_TexCoord 纹理坐标 . in
      * @param gl_Transform 变换矩阵 . in
      * @param gl_Color 顶点颜色 . out , default {0,0,0}
      */
     virtual void vertex(
-        Vec3&        gl_Position,
+        Vec4&        gl_Position,
         const Vec2&  gl_TexCoord,
         const Mat44& gl_Transform,
         Color&       gl_Color) = 0;
@@ -0,0 +1,72 @@
+﻿//
+// Created by IMEI on 2022/9/12.
+//
+
+#ifndef MINI_ENGINE_DISTRIBUTION_HPP
+#define MINI_ENGINE_DISTRIBUTION_HPP
+
+#include "math/vec.hpp"
+#include <vector>
+#include <stdexcept>
+
+namespace mne {
+
+// 离散分布的别名表 , 构建O(n) , 采样O(1)
+// Michael D. Vose. A Linear Algorithm For Generating Random Numbers With a Given Distribution. 1991
+class AliasTable {
+    std::vector<number> prob;  // 落在自身格子时保留的概率
+    std::vector<int>    alias; // 未保留时转移到的下标
+    std::vector<number> pmf;   // 每个下标被选中的概率
+
+public:
+    // 按权重构建 , 权重之和为0时表为空
+    void build(const std::vector<number>& weights) {
+        int    n   = (int) weights.size();
+        number sum = 0_n;
+        for (auto w : weights) {
+            if (w < 0) throw std::runtime_error("probability can less than 0");
+            sum += w;
+        }
+        prob.assign(n, 1_n), alias.assign(n, 0), pmf.assign(n, 0_n);
+        if (sum <= 0_n) return prob.clear(), alias.clear(), pmf.clear();
+
+        // 放大到平均值为1 , 按是否小于1分组
+        std::vector<number> scaled(n);
+        std::vector<int>    small, large;
+        for (int i = 0; i < n; ++i) {
+            pmf[i]    = weights[i] / sum;
+            scaled[i] = pmf[i] * number(n);
+            (scaled[i] < 1_n ? small : large).push_back(i);
+        }
+        // 每次用一个大格子填满一个小格子
+        while (!small.empty() && !large.empty()) {
+            int s = small.back(), l = large.back();
+            small.pop_back();
+            prob[s] = scaled[s], alias[s] = l;
+            scaled[l] -= 1_n - scaled[s];
+            if (scaled[l] < 1_n) large.pop_back(), small.push_back(l);
+        }
+        // 剩余格子只受舍入误差影响 , 直接保留
+        for (int i : small) prob[i] = 1_n, alias[i] = i;
+        for (int i : large) prob[i] = 1_n, alias[i] = i;
+    }
+
+    // u为[0,1)上的均匀随机数
+    int sample(number u) const {
+        int    n      = size();
+        number scaled = u * number(n);
+        int    i      = std::min(int(scaled), n - 1);
+        return scaled - number(i) < prob[i] ? i : alias[i];
+    }
+
+    // 下标i被选中的概率
+    number probability(int i) const { return pmf[i]; }
+
+    int size() const { return (int) prob.size(); }
+
+    bool empty() const { return prob.empty(); }
+};
+
+} // namespace mne
+
+#endif //MINI_ENGINE_DISTRIBUTION_HPP
@@ -11,11 +11,13 @@
 
 /*
  本模块实现了定长矩阵的数值运算,并提供了便捷构造变换矩阵的工厂函数.
+ SSE可用时Mat44的乘法按行/列的__m128计算 , 累加顺序与标量实现一致.
+ 元素类型默认为number , 世界空间的变换使用real.
  */
 
 namespace mne {
 
-template<int M, int N>
+template<int M, int N, class T = number>
 class Mat;
 
 // 别名
@@ -23,16 +25,21 @@ using Mat33 = Mat<3, 3>;
 using Mat34 = Mat<3, 4>;
 using Mat43 = Mat<4, 3>;
 using Mat44 = Mat<4, 4>;
+// 世界空间的变换矩阵
+using Mat44r = Mat<4, 4, real>;
 
-template<int M, int N>
+template<int M, int N, class T>
 class Mat {
-    Vec<N> data[M]{};
+    Vec<N, T> data[M]{};
+
+    // 4x4的float矩阵使用SIMD实现
+    static constexpr bool packed = M == 4 && N == 4 && Vec<N, T>::packed;
 
 public:
 #pragma region 构造相关
     constexpr Mat() = default;
 
-    constexpr Mat(const std::initializer_list<Vec<N>>& init) {
+    constexpr Mat(const std::initializer_list<Vec<N, T>>& init) {
         int i = 0;
         for (auto& row : init) {
             data[i++] = row;
@@ -44,8 +51,24 @@ public:
 #pragma region 运算符重载
     // * mat
     template<int C>
-    constexpr friend Mat<M, C> operator*(const Mat<M, N>& lhs, const Mat<N, C>& rhs) {
-        Mat<M, C> res;
+    constexpr friend Mat<M, C, T> operator*(const Mat<M, N, T>& lhs, const Mat<N, C, T>& rhs) {
+#ifdef MNE_SIMD_SSE
+        if constexpr (packed && C == 4) {
+            if (!std::is_constant_evaluated()) {
+                // 结果的第i行 = sum(lhs(i,k) * rhs的第k行)
+                Mat<M, C, T> res;
+                for (int i = 0; i < M; i++) {
+                    __m128 row = _mm_setzero_ps();
+                    for (int k = 0; k < N; k++) {
+                        row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(lhs.at(i, k)), rhs.data[k].simd()));
+                    }
+                    res.data[i].assign(row);
+                }
+                return res;
+            }
+        }
+#endif
+        Mat<M, C, T> res;
         for (int i = 0; i < M; i++) {
             for (int k = 0; k < N; k++) {
                 for (int j = 0; j < C; j++) {
@@ -59,13 +82,22 @@ public:
     // A/B = A*B.invert()
     // <M,N>/<C,N> <M,N> * <N,C>
     template<int C>
-    constexpr friend Mat<M, C> operator/(const Mat<M, N>& lhs, const Mat<C, N>& rhs) {
+    constexpr friend Mat<M, C, T> operator/(const Mat<M, N, T>& lhs, const Mat<C, N, T>& rhs) {
         return lhs * rhs.invert(); // Todo 使用高斯消元优化
     }
 
     // * vec
-    constexpr friend Vec<M> operator*(const Mat<M, N>& lhs, const Vec<N>& rhs) {
-        Vec<M> ret;
+    constexpr friend Vec<M, T> operator*(const Mat<M, N, T>& lhs, const Vec<N, T>& rhs) {
+#ifdef MNE_SIMD_SSE
+        if constexpr (packed) {
+            if (!std::is_constant_evaluated()) {
+                __m128 c[4];
+                lhs.cols(c);
+                return Vec<M, T>::fromSimd(_mm_add_ps(combine(c, rhs), _mm_mul_ps(c[3], _mm_set1_ps(rhs.w()))));
+            }
+        }
+#endif
+        Vec<M, T> ret;
         for (int i = 0; i < M; i++) {
             ret[i] = lhs.row(i) * rhs;
         }
@@ -73,8 +105,8 @@ public:
     }
 
     // vec *
-    constexpr friend Vec<N> operator*(const Vec<M>& rhs, const Mat<M, N>& lhs) {
-        Vec<N> ret;
+    constexpr friend Vec<N, T> operator*(const Vec<M, T>& rhs, const Mat<M, N, T>& lhs) {
+        Vec<N, T> ret;
         for (int i = 0; i < N; i++) {
             ret[i] = rhs * lhs.col(i); // Todo 优化右乘
         }
@@ -98,7 +130,7 @@ public:
     }
 
     // *= k
-    constexpr Mat& operator*=(number k) {
+    constexpr Mat& operator*=(T k) {
         for (int i = 0; i < M; i++) {
             data[i] *= k;
         }
@@ -106,7 +138,7 @@ public:
     }
 
     // /= k
-    constexpr Mat& operator/=(number k) {
+    constexpr Mat& operator/=(T k) {
         for (int i = 0; i < M; i++) {
             data[i] /= k;
         }
@@ -120,20 +152,20 @@ public:
     constexpr friend Mat operator-(const Mat& lhs, const Mat& rhs) { return Mat{lhs} -= rhs; }
 
     // * k
-    constexpr friend Mat operator*(const Mat& lhs, number k) { return Mat{lhs} *= k; }
-    constexpr friend Mat operator*(number k, const Mat& lhs) { return Mat{lhs} *= k; }
+    constexpr friend Mat operator*(const Mat& lhs, T k) { return Mat{lhs} *= k; }
+    constexpr friend Mat operator*(T k, const Mat& lhs) { return Mat{lhs} *= k; }
 
     // / k
-    constexpr friend Mat operator/(const Mat& lhs, number k) { return Mat{lhs} /= k; }
+    constexpr friend Mat operator/(const Mat& lhs, T k) { return Mat{lhs} /= k; }
 #pragma endregion
 public:
 #pragma region 非运算符函数
     // 求行列式
-    constexpr number det() const requires(M == N) {
+    constexpr T det() const requires(M == N) {
         if constexpr (N == 1) {
             return at(0, 0);
         } else {
-            number ret{};
+            T ret{};
             for (int j = 0; j < N; ++j) {
                 ret += at(0, j) * exclude_det(0, j);
             }
@@ -142,8 +174,8 @@ public:
     }
 
     // 转置
-    constexpr Mat<N, M> flap() const {
-        Mat<N, M> res;
+    constexpr Mat<N, M, T> flap() const {
+        Mat<N, M, T> res;
         for (int j = 0; j < N; j++) {
             for (int i = 0; i < M; i++) {
                 res.at(i, j) = data[j][i];
@@ -153,9 +185,9 @@ public:
     }
 
     // 逆矩阵
-    constexpr Mat<N, M> invert() const requires(M == N) {
-        Mat<N, M> res;
-        number    dt = det();
+    constexpr Mat<N, M, T> invert() const requires(M == N) {
+        Mat<N, M, T> res;
+        T            dt = det();
         for (int i = 0; i < M; i++) {
             for (int j = 0; j < N; j++) {
                 res.at(i, j) = exclude_det(i, j) / dt;
@@ -166,8 +198,8 @@ public:
 
     // 转换为其他尺寸的矩阵
     template<int P, int Q>
-    constexpr Mat<P, Q> as(number fill = 0) const {
-        Mat<P, Q> res;
+    constexpr Mat<P, Q, T> as(T fill = 0) const {
+        Mat<P, Q, T> res;
         for (int i = 0; i < P; i++) {
             for (int j = 0; j < Q; j++) {
                 res.at(i, j) = out_range(i, j) ? fill : at(i, j);
@@ -176,40 +208,91 @@ public:
         return res;
     }
 
+    // 转换精度
+    template<class U>
+    constexpr Mat<M, N, U> cast() const {
+        Mat<M, N, U> res;
+        for (int i = 0; i < M; i++) res.row(i) = data[i].template cast<U>();
+        return res;
+    }
+
     // 3x3变换矩阵转为4x4变换矩阵
-    constexpr Mat44 as4() const requires(M == 3 && N == 3) {
-        Mat44 res    = as<4, 4>();
+    constexpr Mat<4, 4, T> as4() const requires(M == 3 && N == 3) {
+        Mat<4, 4, T> res = as<4, 4>();
+        res.at(3, 3) = 1;
+        return res;
+    }
+
+    // 特化Mat44 x Vec3 , 按w=1变换后做透视除法
+    constexpr Vec<3, T> operator*(const Vec<3, T>& rhs) const requires(M == 4 && N == 4) {
+#ifdef MNE_SIMD_SSE
+        if constexpr (packed) {
+            if (!std::is_constant_evaluated()) {
+                __m128 c[4];
+                cols(c);
+                __m128 p = _mm_add_ps(combine(c, rhs), c[3]);
+                T      w = _mm_cvtss_f32(_mm_shuffle_ps(p, p, _MM_SHUFFLE(3, 3, 3, 3)));
+                if (w > eps || w < -eps) p = _mm_div_ps(p, _mm_set1_ps(w));
+                return Vec<3, T>::fromSimd(p);
+            }
+        }
+#endif
+        return (*this * rhs.template as<4>()).trim().template as<3>();
+    }
+
+    // 仿射变换(末行为0,0,0,1)的逆矩阵 , 线性部分用伴随矩阵求逆
+    constexpr Mat<4, 4, T> affineInvert() const requires(M == 4 && N == 4) {
+        Vec<3, T>    a = col(0).template as<3>(), b = col(1).template as<3>(), c = col(2).template as<3>();
+        Vec<3, T>    t = col(3).template as<3>();
+        Vec<3, T>    rows[3] = {b.cross(c), c.cross(a), a.cross(b)};
+        T            dt      = a * rows[0];
+        Mat<4, 4, T> res;
+        for (int i = 0; i < 3; i++) {
+            rows[i] /= dt;
+            res.data[i] = concat_vec(rows[i], Vec<1, T>{-(rows[i] * t)});
+        }
         res.at(3, 3) = 1;
         return res;
     }
 
-    // 特化Mat44 x Vec3
-    constexpr Vec3 operator*(const Vec3& rhs) const requires(M == 4 && N == 4) {
-        return (*this * rhs.as<4>()).trim().template as<3>();
+#ifdef MNE_SIMD_SSE
+    // 按列载入4x4矩阵
+    void cols(__m128 (&c)[4]) const requires(packed) {
+        for (int i = 0; i < 4; i++) c[i] = data[i].simd();
+        _MM_TRANSPOSE4_PS(c[0], c[1], c[2], c[3]);
+    }
+
+    // 前3列按v的分量线性组合 , 每个通道的累加顺序与逐行的Vec3点积一致
+    template<int K>
+    static __m128 combine(const __m128 (&c)[4], const Vec<K, T>& v) requires(packed && K >= 3) {
+        __m128 ret = _mm_add_ps(_mm_setzero_ps(), _mm_mul_ps(c[0], _mm_set1_ps(v.x())));
+        ret        = _mm_add_ps(ret, _mm_mul_ps(c[1], _mm_set1_ps(v.y())));
+        return _mm_add_ps(ret, _mm_mul_ps(c[2], _mm_set1_ps(v.z())));
     }
+#endif
 
 #pragma endregion
 public:
 #pragma region 访问函数
-    constexpr number& atc(int i, int j) {
+    constexpr T& atc(int i, int j) {
         if (out_range(i, j)) throw std::out_of_range("mat::at");
         return data[i][j];
     }
 
-    constexpr number atc(int i, int j) const {
+    constexpr T atc(int i, int j) const {
         if (out_range(i, j)) throw std::out_of_range("mat::at");
         return data[i][j];
     }
 
-    constexpr number& at(int i, int j) { return data[i][j]; }
+    constexpr T& at(int i, int j) { return data[i][j]; }
 
-    constexpr number at(int i, int j) const { return data[i][j]; }
+    constexpr T at(int i, int j) const { return data[i][j]; }
 
-    constexpr Vec<N>& row(int i) { return data[i]; }
-    constexpr Vec<N>  row(int i) const { return data[i]; }
+    constexpr Vec<N, T>& row(int i) { return data[i]; }
+    constexpr Vec<N, T>  row(int i) const { return data[i]; }
 
-    constexpr Vec<M> col(int j) const {
-        Vec<M> ret;
+    constexpr Vec<M, T> col(int j) const {
+        Vec<M, T> ret;
         for (int i = 0; i < M; i++) ret[i] = at(i, j);
         return ret;
     }
@@ -222,8 +305,8 @@ private:
     }
 
     // 获取余子式
-    constexpr Mat<M - 1, N - 1> exclude(int ei, int ej) const {
-        Mat<M - 1, N - 1> ret;
+    constexpr Mat<M - 1, N - 1, T> exclude(int ei, int ej) const {
+        Mat<M - 1, N - 1, T> ret;
         for (int i = M - 1; i--;)
             for (int j = N - 1; j--;)
                 ret.at(i, j) = at(i < ei ? i : i + 1, j < ej ? j : j + 1);
@@ -231,7 +314,7 @@ private:
     }
 
     // 获取代数余子式的值
-    constexpr number exclude_det(int i, int j) const {
+    constexpr T exclude_det(int i, int j) const {
         return exclude(i, j).det() * ((i + j) % 2 ? -1 : 1);
     }
 #pragma endregion
@@ -0,0 +1,259 @@
+﻿//
+// Created by IMEI on 2022/9/14.
+//
+
+#ifndef MINI_ENGINE_SIMD_HPP
+#define MINI_ENGINE_SIMD_HPP
+
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+
+/*
+ 定长的SIMD浮点向量和通道掩码 , 在编译期根据指令集选择实现
+ - SimdFloat<4> : SSE2
+ - SimdFloat<8> : AVX2
+ - 其他宽度 , 或定义了MNE_SIMD_SCALAR时 : 逐通道循环的标量实现
+ 通道掩码的第i位对应第i个通道
+ 逐通道的最值命名为vmin/vmax , 避免与AABB::min等成员同名时无法按实参查找
+ */
+
+#if !defined(MNE_SIMD_SCALAR) && (defined(__SSE2__) || defined(_M_X64) || defined(__AVX2__))
+    #define MNE_SIMD_SSE
+    #include <emmintrin.h>
+#endif
+#if !defined(MNE_SIMD_SCALAR) && defined(__AVX2__)
+    #define MNE_SIMD_AVX2
+    #include <immintrin.h>
+#endif
+
+namespace mne {
+
+// 光线包等默认使用的宽度
+#ifdef MNE_SIMD_AVX2
+constexpr int simd_width = 8;
+#else
+constexpr int simd_width = 4;
+#endif
+
+#pragma region 标量实现
+template<int W>
+struct SimdMask {
+    uint32_t bits{};
+
+    static SimdMask fromBits(uint32_t b) { return {b & full()}; }
+
+    bool operator[](int i) const { return (bits >> i) & 1u; }
+    int  movemask() const { return int(bits); }
+    bool any() const { return bits != 0; }
+    bool all() const { return bits == full(); }
+    bool none() const { return bits == 0; }
+
+    friend SimdMask operator&(SimdMask a, SimdMask b) { return {a.bits & b.bits}; }
+    friend SimdMask operator|(SimdMask a, SimdMask b) { return {a.bits | b.bits}; }
+    friend SimdMask operator^(SimdMask a, SimdMask b) { return {a.bits ^ b.bits}; }
+    SimdMask        operator~() const { return {~bits & full()}; }
+
+private:
+    static constexpr uint32_t full() { return W >= 32 ? ~0u : (1u << W) - 1u; }
+};
+
+template<int W>
+struct SimdFloat {
+    float v[W];
+
+    SimdFloat() = default;
+    SimdFloat(float x) { std::fill(v, v + W, x); }
+
+    static SimdFloat load(const float* p) {
+        SimdFloat r;
+        std::copy(p, p + W, r.v);
+        return r;
+    }
+    void store(float* p) const { std::copy(v, v + W, p); }
+
+    float operator[](int i) const { return v[i]; }
+
+#define MNE_SIMD_BINARY(op)                                                    \
+    friend SimdFloat operator op(const SimdFloat& a, const SimdFloat& b) {     \
+        SimdFloat r;                                                           \
+        for (int i = 0; i < W; ++i) r.v[i] = a.v[i] op b.v[i];                 \
+        return r;                                                              \
+    }
+#define MNE_SIMD_COMPARE(op)                                                   \
+    friend SimdMask<W> operator op(const SimdFloat& a, const SimdFloat& b) {   \
+        uint32_t bits = 0;                                                     \
+        for (int i = 0; i < W; ++i) bits |= uint32_t(a.v[i] op b.v[i]) << i;   \
+        return {bits};                                                         \
+    }
+    MNE_SIMD_BINARY(+)
+    MNE_SIMD_BINARY(-)
+    MNE_SIMD_BINARY(*)
+    MNE_SIMD_BINARY(/)
+    MNE_SIMD_COMPARE(<)
+    MNE_SIMD_COMPARE(<=)
+    MNE_SIMD_COMPARE(>)
+    MNE_SIMD_COMPARE(>=)
+#undef MNE_SIMD_BINARY
+#undef MNE_SIMD_COMPARE
+
+    SimdFloat operator-() const { return SimdFloat(0.f) - *this; }
+
+    friend SimdFloat vmin(const SimdFloat& a, const SimdFloat& b) {
+        SimdFloat r;
+        for (int i = 0; i < W; ++i) r.v[i] = std::min(a.v[i], b.v[i]);
+        return r;
+    }
+    friend SimdFloat vmax(const SimdFloat& a, const SimdFloat& b) {
+        SimdFloat r;
+        for (int i = 0; i < W; ++i) r.v[i] = std::max(a.v[i], b.v[i]);
+        return r;
+    }
+    friend SimdFloat sqrt(const SimdFloat& a) {
+        SimdFloat r;
+        for (int i = 0; i < W; ++i) r.v[i] = std::sqrt(a.v[i]);
+        return r;
+    }
+    friend SimdFloat abs(const SimdFloat& a) {
+        SimdFloat r;
+        for (int i = 0; i < W; ++i) r.v[i] = std::abs(a.v[i]);
+        return r;
+    }
+    // mask为真的通道取a , 否则取b
+    friend SimdFloat select(const SimdMask<W>& m, const SimdFloat& a, const SimdFloat& b) {
+        SimdFloat r;
+        for (int i = 0; i < W; ++i) r.v[i] = m[i] ? a.v[i] : b.v[i];
+        return r;
+    }
+};
+#pragma endregion
+
+#ifdef MNE_SIMD_SSE
+#pragma region SSE实现
+template<>
+struct SimdMask<4> {
+    __m128 m;
+
+    static SimdMask fromBits(uint32_t b) {
+        return {_mm_castsi128_ps(_mm_set_epi32(b & 8 ? -1 : 0, b & 4 ? -1 : 0, b & 2 ? -1 : 0, b & 1 ? -1 : 0))};
+    }
+
+    bool operator[](int i) const { return (movemask() >> i) & 1; }
+    int  movemask() const { return _mm_movemask_ps(m); }
+    bool any() const { return movemask() != 0; }
+    bool all() const { return movemask() == 0xF; }
+    bool none() const { return movemask() == 0; }
+
+    friend SimdMask operator&(SimdMask a, SimdMask b) { return {_mm_and_ps(a.m, b.m)}; }
+    friend SimdMask operator|(SimdMask a, SimdMask b) { return {_mm_or_ps(a.m, b.m)}; }
+    friend SimdMask operator^(SimdMask a, SimdMask b) { return {_mm_xor_ps(a.m, b.m)}; }
+    SimdMask        operator~() const { return {_mm_xor_ps(m, _mm_castsi128_ps(_mm_set1_epi32(-1)))}; }
+};
+
+template<>
+struct SimdFloat<4> {
+    __m128 v;
+
+    SimdFloat() = default;
+    SimdFloat(__m128 x): v(x) {}
+    SimdFloat(float x): v(_mm_set1_ps(x)) {}
+
+    static SimdFloat load(const float* p) { return _mm_loadu_ps(p); }
+    void             store(float* p) const { _mm_storeu_ps(p, v); }
+
+    float operator[](int i) const {
+        alignas(16) float tmp[4];
+        _mm_store_ps(tmp, v);
+        return tmp[i];
+    }
+
+    friend SimdFloat operator+(const SimdFloat& a, const SimdFloat& b) { return _mm_add_ps(a.v, b.v); }
+    friend SimdFloat operator-(const SimdFloat& a, const SimdFloat& b) { return _mm_sub_ps(a.v, b.v); }
+    friend SimdFloat operator*(const SimdFloat& a, const SimdFloat& b) { return _mm_mul_ps(a.v, b.v); }
+    friend SimdFloat operator/(const SimdFloat& a, const SimdFloat& b) { return _mm_div_ps(a.v, b.v); }
+    SimdFloat        operator-() const { return _mm_xor_ps(v, _mm_set1_ps(-0.f)); }
+
+    friend SimdMask<4> operator<(const SimdFloat& a, const SimdFloat& b) { return {_mm_cmplt_ps(a.v, b.v)}; }
+    friend SimdMask<4> operator<=(const SimdFloat& a, const SimdFloat& b) { return {_mm_cmple_ps(a.v, b.v)}; }
+    friend SimdMask<4> operator>(const SimdFloat& a, const SimdFloat& b) { return {_mm_cmpgt_ps(a.v, b.v)}; }
+    friend SimdMask<4> operator>=(const SimdFloat& a, const SimdFloat& b) { return {_mm_cmpge_ps(a.v, b.v)}; }
+
+    // 与std::min/std::max的NaN处理一致 : 任一参数为NaN时返回第一个参数
+    friend SimdFloat vmin(const SimdFloat& a, const SimdFloat& b) { return _mm_min_ps(b.v, a.v); }
+    friend SimdFloat vmax(const SimdFloat& a, const SimdFloat& b) { return _mm_max_ps(b.v, a.v); }
+    friend SimdFloat sqrt(const SimdFloat& a) { return _mm_sqrt_ps(a.v); }
+    friend SimdFloat abs(const SimdFloat& a) { return _mm_andnot_ps(_mm_set1_ps(-0.f), a.v); }
+    friend SimdFloat select(const SimdMask<4>& m, const SimdFloat& a, const SimdFloat& b) {
+        return _mm_or_ps(_mm_and_ps(m.m, a.v), _mm_andnot_ps(m.m, b.v));
+    }
+};
+#pragma endregion
+#endif
+
+#ifdef MNE_SIMD_AVX2
+#pragma region AVX2实现
+template<>
+struct SimdMask<8> {
+    __m256 m;
+
+    static SimdMask fromBits(uint32_t b) {
+        __m256i bit = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+        __m256i set = _mm256_and_si256(_mm256_set1_epi32(int(b)), bit);
+        return {_mm256_castsi256_ps(_mm256_cmpeq_epi32(set, bit))};
+    }
+
+    bool operator[](int i) const { return (movemask() >> i) & 1; }
+    int  movemask() const { return _mm256_movemask_ps(m); }
+    bool any() const { return movemask() != 0; }
+    bool all() const { return movemask() == 0xFF; }
+    bool none() const { return movemask() == 0; }
+
+    friend SimdMask operator&(SimdMask a, SimdMask b) { return {_mm256_and_ps(a.m, b.m)}; }
+    friend SimdMask operator|(SimdMask a, SimdMask b) { return {_mm256_or_ps(a.m, b.m)}; }
+    friend SimdMask operator^(SimdMask a, SimdMask b) { return {_mm256_xor_ps(a.m, b.m)}; }
+    SimdMask        operator~() const { return {_mm256_xor_ps(m, _mm256_castsi256_ps(_mm256_set1_epi32(-1)))}; }
+};
+
+template<>
+struct SimdFloat<8> {
+    __m256 v;
+
+    SimdFloat() = default;
+    SimdFloat(__m256 x): v(x) {}
+    SimdFloat(float x): v(_mm256_set1_ps(x)) {}
+
+    static SimdFloat load(const float* p) { return _mm256_loadu_ps(p); }
+    void             store(float* p) const { _mm256_storeu_ps(p, v); }
+
+    float operator[](int i) const {
+        alignas(32) float tmp[8];
+        _mm256_store_ps(tmp, v);
+        return tmp[i];
+    }
+
+    friend SimdFloat operator+(const SimdFloat& a, const SimdFloat& b) { return _mm256_add_ps(a.v, b.v); }
+    friend SimdFloat operator-(const SimdFloat& a, const SimdFloat& b) { return _mm256_sub_ps(a.v, b.v); }
+    friend SimdFloat operator*(const SimdFloat& a, const SimdFloat& b) { return _mm256_mul_ps(a.v, b.v); }
+    friend SimdFloat operator/(const SimdFloat& a, const SimdFloat& b) { return _mm256_div_ps(a.v, b.v); }
+    SimdFloat        operator-() const { return _mm256_xor_ps(v, _mm256_set1_ps(-0.f)); }
+
+    friend SimdMask<8> operator<(const SimdFloat& a, const SimdFloat& b) { return {_mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ)}; }
+    friend SimdMask<8> operator<=(const SimdFloat& a, const SimdFloat& b) { return {_mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ)}; }
+    friend SimdMask<8> operator>(const SimdFloat& a, const SimdFloat& b) { return {_mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ)}; }
+    friend SimdMask<8> operator>=(const SimdFloat& a, const SimdFloat& b) { return {_mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ)}; }
+
+    // 与std::min/std::max的NaN处理一致 : 任一参数为NaN时返回第一个参数
+    friend SimdFloat vmin(const SimdFloat& a, const SimdFloat& b) { return _mm256_min_ps(b.v, a.v); }
+    friend SimdFloat vmax(const SimdFloat& a, const SimdFloat& b) { return _mm256_max_ps(b.v, a.v); }
+    friend SimdFloat sqrt(const SimdFloat& a) { return _mm256_sqrt_ps(a.v); }
+    friend SimdFloat abs(const SimdFloat& a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.f), a.v); }
+    friend SimdFloat select(const SimdMask<8>& m, const SimdFloat& a, const SimdFloat& b) {
+        return _mm256_blendv_ps(b.v, a.v, m.m);
+    }
+};
+#pragma endregion
+#endif
+
+} // namespace mne
+
+#endif //MINI_ENGINE_SIMD_HPP
@@ -8,19 +8,51 @@
 #include "math/vec.hpp"
 #include "math/mat.hpp"
 #include <concepts>
-#include <random>
+#include <cstdint>
 #include <ctime>
 
 namespace mne {
 
 /// 随机数工具函数
+/// 基于计数器的随机数 : 第i次取值为hash(key, i) , key由(像素,样本)决定
+/// 每个线程持有独立的key和计数器 , 结果与线程数量和调度顺序无关
 class RandomUtils {
 public:
+    struct Stream {
+        uint64_t key; // 当前样本的键
+        uint64_t dim; // 已经消耗的维度
+    };
+
+private:
+    static inline thread_local Stream stream{};
+
+    // splitmix64的终结函数 , 把相邻的计数映射为不相关的值
+    static constexpr uint64_t mix(uint64_t z) {
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+    static constexpr uint64_t golden = 0x9E3779B97F4A7C15ull;
+
+public:
+    // 为(pixel, sample)开始一条新的随机数序列
+    static void seed(uint64_t pixel, uint64_t sample) {
+        stream = {mix(mix(pixel + golden) ^ (sample * golden)), 0};
+    }
+
+    // 保存和恢复当前序列 , 用于在同一线程中交替推进多条路径
+    static Stream save() { return stream; }
+    static void   restore(const Stream& state) { stream = state; }
+
+    // 当前序列的下一个32位随机数
+    static uint32_t next() {
+        return uint32_t(mix(stream.key + ++stream.dim * golden) >> 32);
+    }
+
     // [l,r)
     static int randInt(int l, int r) {
-        static auto seed  = 0;                  // time(nullptr);
-        static auto maker = std::mt19937(seed); // NOLINT(cert-msc51-cpp)
-        return int(maker() % (r - l)) + l;
+        return int((uint64_t(next()) * uint64_t(r - l)) >> 32) + l;
     }
 
     // [0,n)
@@ -28,9 +60,9 @@ public:
         return randInt(0, n);
     }
 
-    // [0,1)
+    // [0,1) , 取高24位保证float可以精确表示
     static number randFloat() {
-        return (number) randInt(RAND_MAX) / number(RAND_MAX);
+        return number(next() >> 8) * number(0x1p-24);
     }
 
     // [l,r)
@@ -240,7 +272,7 @@ public:
 
     // 3维向量转反对称矩阵
     constexpr static Mat33 anti(const Vec3& input) {
-        auto [x, y, z] = input.data;
+        number x = input.x(), y = input.y(), z = input.z();
         return {
             {0, -z, y},
             {z, 0, -x},
@@ -280,6 +312,38 @@ public:
         return mat2xyz(merge(rotateY(theta_phi.x()), rotate(x, theta_phi.y())));
     }
 
+    // 仿射变换作用于点(w=1) , 不做透视除法 , 结果的精度与矩阵一致
+    template<class T>
+    static constexpr Vec<3, T> applyPoint(const Mat<4, 4, T>& m, const std::type_identity_t<Vec<3, T>>& p) {
+#ifdef MNE_SIMD_SSE
+        if constexpr (Vec<3, T>::packed) {
+            if (!std::is_constant_evaluated()) {
+                __m128 c[4];
+                m.cols(c);
+                return Vec<3, T>::fromSimd(_mm_add_ps(Mat<4, 4, T>::combine(c, p), c[3]));
+            }
+        }
+#endif
+        return {m.row(0).template as<3>() * p + m.at(0, 3),
+                m.row(1).template as<3>() * p + m.at(1, 3),
+                m.row(2).template as<3>() * p + m.at(2, 3)};
+    }
+
+    // 仿射变换作用于向量(w=0)
+    template<class T>
+    static constexpr Vec<3, T> applyDir(const Mat<4, 4, T>& m, const std::type_identity_t<Vec<3, T>>& d) {
+#ifdef MNE_SIMD_SSE
+        if constexpr (Vec<3, T>::packed) {
+            if (!std::is_constant_evaluated()) {
+                __m128 c[4];
+                m.cols(c);
+                return Vec<3, T>::fromSimd(Mat<4, 4, T>::combine(c, d));
+            }
+        }
+#endif
+        return {m.row(0).template as<3>() * d, m.row(1).template as<3>() * d, m.row(2).template as<3>() * d};
+    }
+
 #pragma endregion
 public:
 #pragma region 旋转矩阵3x3
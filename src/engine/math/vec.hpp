@@ -10,12 +10,31 @@
 #include <iostream>
 #include <numbers>
 #include <limits>
+#include <type_traits>
+#include "simd.hpp"
 
 namespace mne {
 
+/*
+ 精度策略 , 在编译期选择
+ - number : 着色,颜色,图像缓存,物体参数和SIMD求交 , 固定为float
+ - real   : 世界空间的射线起点,碰撞点,求交距离和变换矩阵的累积 , 定义MNE_DOUBLE_PRECISION时为double
+ 两种精度的向量之间只能隐式地向高精度转换 , 降低精度需要显式调用cast
+ */
+
 using number = float;
 
-constexpr number eps = 1e-8f;
+#ifdef MNE_DOUBLE_PRECISION
+using real = double;
+#else
+using real = number;
+#endif
+
+// 与0比较的阈值 , 需高于对应类型的分辨率
+template<class T>
+constexpr T eps_v = std::is_same_v<T, double> ? T(1e-12) : T(1e-6);
+
+constexpr number eps = eps_v<number>;
 constexpr number inf = std::numeric_limits<number>::infinity();
 constexpr number pi  = std::numbers::pi_v<number>;
 constexpr number pi2 = pi * 2;
@@ -30,20 +49,51 @@ constexpr number operator""_n(long double val) {
     return number(val);
 }
 
-template<int N>
+/*
+ SSE可用时Vec3/Vec4按一个__m128对齐存储 , Vec3补齐一个填充分量
+ - 运算在编译期求值时走逐分量的标量实现 , 运行期走SIMD实现
+ - 填充分量的值不确定 , 不参与任何结果
+ - 逐分量运算和叉积与标量实现的结果逐位相同
+ 定义MNE_SIMD_SCALAR时全部回退到标量实现
+ */
+
+template<int N, class T = number>
 requires(N >= 1) struct Vec {
-    number data[N] = {};
+#ifdef MNE_SIMD_SSE
+    static constexpr bool packed = std::is_same_v<T, float> && (N == 3 || N == 4);
+#else
+    static constexpr bool packed = false;
+#endif
+
+    alignas(packed ? 16 : alignof(T)) T data[packed ? 4 : N] = {};
+
+public:
+#ifdef MNE_SIMD_SSE
+#pragma region SIMD存取
+    __m128 simd() const requires(packed) { return _mm_load_ps(data); }
 
+    static Vec fromSimd(__m128 v) requires(packed) {
+        Vec ret;
+        _mm_store_ps(ret.data, v);
+        return ret;
+    }
+
+    Vec& assign(__m128 v) requires(packed) {
+        _mm_store_ps(data, v);
+        return *this;
+    }
+#pragma endregion
+#endif
 public:
 #pragma region 容器相关
     // 下标访问
-    constexpr number& operator[](int i) { return data[i]; }
-    constexpr number  operator[](int i) const { return data[i]; }
+    constexpr T& operator[](int i) { return data[i]; }
+    constexpr T  operator[](int i) const { return data[i]; }
 
     // 转换为其他长度的向量,如果N<M则用fill填充
     template<int M>
-    constexpr Vec<M> as(number fill = 1) const {
-        Vec<M> ret{};
+    constexpr Vec<M, T> as(T fill = 1) const {
+        Vec<M, T> ret{};
         if constexpr (N < M) {
             for (int i = 0; i < N; ++i) ret[i] = data[i];
             for (int i = N; i < M; ++i) ret[i] = fill;
@@ -55,57 +105,86 @@ public:
 
     // 挑选出某个维度的向量
     template<int... idx>
-    constexpr Vec<sizeof...(idx)> pick() const {
-        return Vec<sizeof...(idx)>{data[idx]...};
+    constexpr Vec<sizeof...(idx), T> pick() const {
+        return Vec<sizeof...(idx), T>{data[idx]...};
+    }
+
+    // 转换精度
+    template<class U>
+    constexpr Vec<N, U> cast() const {
+        Vec<N, U> ret{};
+        for (int i = 0; i < N; ++i) ret[i] = U(data[i]);
+        return ret;
+    }
+
+    // 隐式转换到更高的精度
+    template<class U>
+    constexpr operator Vec<N, U>() const requires(sizeof(U) > sizeof(T)) {
+        return cast<U>();
     }
 
 #pragma endregion
 public:
 #pragma region 非运算符运算
     // 长度的平方
-    constexpr number norm2() const { return *this * *this; }
+    constexpr T norm2() const { return *this * *this; }
     // 向量长度
-    constexpr number length() const { return std::sqrt(norm2()); }
+    constexpr T length() const { return std::sqrt(norm2()); }
     // 归一化
     constexpr Vec normalize() const { return *this / length(); }
 
     // 最值
-    constexpr number v_min() const {
+    constexpr T v_min() const {
         return *std::min_element(data, data + N);
     }
-    constexpr number v_max() const {
+    constexpr T v_max() const {
         return *std::max_element(data, data + N);
     }
 
     // 叉积
     constexpr Vec cross(const Vec& rhs) const requires(N == 3) {
+#ifdef MNE_SIMD_SSE
+        if constexpr (packed) {
+            if (!std::is_constant_evaluated()) {
+                __m128 a = simd(), b = rhs.simd();
+                __m128 a1 = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1)), b1 = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+                __m128 a2 = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 1, 0, 2)), b2 = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 1, 0, 2));
+                return fromSimd(_mm_sub_ps(_mm_mul_ps(a1, b2), _mm_mul_ps(a2, b1)));
+            }
+        }
+#endif
         const Vec& lhs = *this;
         return {lhs[1] * rhs[2] - lhs[2] * rhs[1],
                 lhs[2] * rhs[0] - lhs[0] * rhs[2],
                 lhs[0] * rhs[1] - lhs[1] * rhs[0]};
     }
 
-    constexpr number cdot(const Vec& rhs) const requires(N == 2) {
+    constexpr T cdot(const Vec& rhs) const requires(N == 2) {
         const Vec& lhs = *this;
         return lhs[1] * rhs[0] - lhs[0] * rhs[1];
     }
 
     // this和rhs的夹角, [0, pi]
-    constexpr number inner(const Vec& rhs) const {
+    constexpr T inner(const Vec& rhs) const {
         const Vec& lhs = *this;
         return std::acos((lhs * rhs) / (lhs.length() * rhs.length()));
     }
 
     // this逆时针旋转到target需要的角度
-    constexpr number rotate(const Vec& target) const {
+    constexpr T rotate(const Vec& target) const {
         const Vec &lhs = *this, &rhs = target;
-        number     angle = inner(rhs);
+        T     angle = inner(rhs);
         if (lhs.cdot(rhs) < 0) angle = 2 * pi - angle;
         return angle;
     }
 
     // 按位乘法
     constexpr Vec mut(const Vec& rhs) const {
+#ifdef MNE_SIMD_SSE
+        if constexpr (packed) {
+            if (!std::is_constant_evaluated()) return fromSimd(_mm_mul_ps(simd(), rhs.simd()));
+        }
+#endif
         Vec ret;
         for (int i = 0; i < N; ++i) ret[i] = data[i] * rhs[i];
         return ret;
@@ -113,6 +192,11 @@ public:
 
     // 按位除法
     constexpr Vec div(const Vec& rhs) const {
+#ifdef MNE_SIMD_SSE
+        if constexpr (packed) {
+            if (!std::is_constant_evaluated()) return fromSimd(_mm_div_ps(simd(), rhs.simd()));
+        }
+#endif
         Vec ret;
         for (int i = 0; i < N; ++i) ret[i] = data[i] / rhs[i];
         return ret;
@@ -122,60 +206,80 @@ public:
 public:
 #pragma region 特化函数
     // 平面坐标/向量
-    constexpr number x() const requires(N >= 1) {
+    constexpr T x() const requires(N >= 1) {
         return data[0];
     }
-    constexpr number& x() requires(N >= 1) {
+    constexpr T& x() requires(N >= 1) {
         return data[0];
     }
-    constexpr number y() const requires(N >= 2) {
+    constexpr T y() const requires(N >= 2) {
         return data[1];
     }
-    constexpr number& y() requires(N >= 2) {
+    constexpr T& y() requires(N >= 2) {
         return data[1];
     }
 
     // 空间坐标/向量
-    constexpr number z() const requires(N >= 3) {
+    constexpr T z() const requires(N >= 3) {
         return data[2];
     }
-    constexpr number& z() requires(N >= 3) {
+    constexpr T& z() requires(N >= 3) {
         return data[2];
     }
 
     // 四元数
-    constexpr number w() const requires(N >= 4) {
+    constexpr T w() const requires(N >= 4) {
         return data[3];
     }
-    constexpr number& w() requires(N >= 4) {
+    constexpr T& w() requires(N >= 4) {
         return data[3];
     }
 
     // 仅将w归一化
     constexpr Vec trim() const requires(N == 4) {
         auto W = w();
-        if (W > eps || W < -eps) return *this / W;
+        if (W > eps_v<T> || W < -eps_v<T>) return *this / W;
         return *this;
     }
 #pragma endregion
 public:
 #pragma region 运算符重载
     constexpr Vec& operator+=(const Vec& rhs) {
+#ifdef MNE_SIMD_SSE
+        if constexpr (packed) {
+            if (!std::is_constant_evaluated()) return assign(_mm_add_ps(simd(), rhs.simd()));
+        }
+#endif
         for (int i = 0; i < N; ++i) data[i] += rhs[i];
         return *this;
     }
 
     constexpr Vec& operator-=(const Vec& rhs) {
+#ifdef MNE_SIMD_SSE
+        if constexpr (packed) {
+            if (!std::is_constant_evaluated()) return assign(_mm_sub_ps(simd(), rhs.simd()));
+        }
+#endif
         for (int i = 0; i < N; ++i) data[i] -= rhs[i];
         return *this;
     }
 
-    constexpr Vec& operator*=(number k) {
+    constexpr Vec& operator*=(T k) {
+#ifdef MNE_SIMD_SSE
+        if constexpr (packed) {
+            if (!std::is_constant_evaluated()) return assign(_mm_mul_ps(simd(), _mm_set1_ps(k)));
+        }
+#endif
         for (int i = 0; i < N; ++i) data[i] *= k;
         return *this;
     }
 
-    constexpr Vec& operator/=(number k) {
+    constexpr Vec& operator/=(T k) {
+#ifdef MNE_SIMD_SSE
+        if constexpr (packed) {
+            if (!std::is_constant_evaluated()) return assign(_mm_div_ps(simd(), _mm_set1_ps(k)));
+        }
+#endif
         for (int i = 0; i < N; ++i) data[i] /= k;
         return *this;
     }
@@ -186,18 +290,18 @@ public:
 
     constexpr Vec operator-() const { return *this * -1; }
 
-    // 点乘
-    constexpr friend number operator*(const Vec& lhs, const Vec& rhs) {
-        number ret{};
+    // 点乘 , 顺序累加无法并行 , 横向求和反而更慢 , 保持标量实现
+    constexpr friend T operator*(const Vec& lhs, const Vec& rhs) {
+        T ret{};
         for (int i = 0; i < N; ++i) ret += lhs[i] * rhs[i];
         return ret;
     }
 
-    constexpr friend Vec operator*(const Vec& lhs, number k) { return Vec{lhs} *= k; }
+    constexpr friend Vec operator*(const Vec& lhs, T k) { return Vec{lhs} *= k; }
 
-    constexpr friend Vec operator*(number k, const Vec& rhs) { return rhs * k; }
+    constexpr friend Vec operator*(T k, const Vec& rhs) { return rhs * k; }
 
-    constexpr friend Vec operator/(const Vec& lhs, number k) { return Vec{lhs} /= k; }
+    constexpr friend Vec operator/(const Vec& lhs, T k) { return Vec{lhs} /= k; }
 
     // IO相关
     friend std::ostream& operator<<(std::ostream& os, const Vec& vec) {
@@ -217,6 +321,8 @@ using Vec2 = Vec<2>;
 using Vec3 = Vec<3>;
 // 四元数
 using Vec4 = Vec<4>;
+// 世界空间的坐标/向量
+using Vec3r = Vec<3, real>;
 
 // 创建向量
 template<class... Args>
@@ -225,10 +331,10 @@ inline constexpr auto make_vec(Args&&... args) requires((std::is_nothrow_convert
 }
 
 // 拼接多个向量
-template<int A, int B, int... N>
-inline constexpr auto concat_vec(const Vec<A>& a, const Vec<B>& b, const Vec<N>&... args) {
+template<int A, int B, int... N, class T>
+inline constexpr auto concat_vec(const Vec<A, T>& a, const Vec<B, T>& b, const Vec<N, T>&... args) {
     if constexpr (sizeof...(N) == 0) {
-        Vec<A + B> ret{};
+        Vec<A + B, T> ret{};
         for (int i = 0; i < A; ++i) ret[i] = a[i];
         for (int i = 0; i < B; ++i) ret[i + A] = b[i];
         return ret;
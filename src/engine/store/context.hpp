@@ -11,6 +11,8 @@
 #include "implement/objects/sphere.hpp"
 #include "implement/objects/rectangle.hpp"
 #include "implement/objects/cube.hpp"
+#include "implement/objects/triangle.hpp"
+#include "implement/objects/instance.hpp"
 
 #include "implement/material/diffuse.hpp"
 #include "implement/material/mirror.hpp"
@@ -58,7 +60,7 @@ private:
         // 是否开启ui
         this->ui = render.value("ui", false);
         // 创建渲染器
-        this->render = toRender(render.at("type"));
+        this->render = toRender(render);
         // 填充基础字段
         this->render->spp        = render.at("spp");
         this->render->background = toColor(render.at("background"));
@@ -85,6 +87,8 @@ private:
         json   vars    = scene.value("vars", json::object());
         json   objects = scene.value("objects", json::object());
         json   models  = scene.value("models", json::array());
+        json   protos  = scene.value("prototypes", json::object());
+        json   insts   = scene.value("instances", json::array());
         // 引入符号表
         loadVars(vars);
         // Todo 优化上下文结构和导入逻辑
@@ -96,10 +100,25 @@ private:
                 }
             }
         }
-        // 加载模型
+        // 加载模型 , 光线追踪时模型作为三角形网格参与求交
+        bool traced = render.at("type") == "rt";
         for (auto& model : models) {
             if (!model.value("hide", false)) {
-                this->render->scene->addModel(toModel(model));
+                if (traced) {
+                    this->render->scene->addObject(toMesh(model));
+                } else {
+                    this->render->scene->addModel(toModel(model));
+                }
+            }
+        }
+        // 加载实例 , 原型只构建一次 , 由多个实例共享
+        check(traced || insts.empty(), "instances are only supported by rt render", true);
+        if (!traced) return;
+        std::map<std::string, std::shared_ptr<IObject>> prototypes;
+        for (auto&& [name, proto] : protos.items()) prototypes[name] = toPrototype(proto);
+        for (auto& inst : insts) {
+            if (!inst.value("hide", false)) {
+                this->render->scene->addObject(toInstance(inst, prototypes));
             }
         }
     }
@@ -135,11 +154,20 @@ private:
     }
 
 private:
-    static std::shared_ptr<IRender> toRender(const std::string& type) {
+    static std::shared_ptr<IRender> toRender(const json& obj) {
+        std::string type = obj.at("type");
         if (type == "rt") {
-            return std::make_shared<RtRender>();
+            auto rt       = std::make_shared<RtRender>();
+            rt->max_depth = obj.value("max_depth", rt->max_depth);
+            rt->rr_depth  = obj.value("rr_depth", rt->rr_depth);
+            rt->builder   = toBuilder(obj.value("builder", "sah"));
+            rt->setTileSize(obj.value("tile", 16));
+            return rt;
         } else if (type == "rs") {
-            return std::make_shared<RsRender>();
+            auto rs           = std::make_shared<RsRender>();
+            rs->front_to_back = obj.value("front_to_back", rs->front_to_back);
+            rs->cull          = toCull(obj.value("cull", "back"));
+            return rs;
         } else {
             throw std::runtime_error("render type error");
         }
@@ -218,6 +246,75 @@ private:
         return model;
     }
 
+    std::shared_ptr<IObject> toMesh(const json& obj) {
+        std::string objPath     = obj.at("objPath");
+        std::string texturePath = obj.value("texturePath", "");
+
+        std::shared_ptr<IMaterial> material{};
+        if (obj.contains("material")) {
+            material = toMaterial(obj.at("material"));
+        } else if (!texturePath.empty()) {
+            // 缺省使用模型的颜色纹理作为漫反射率
+            material = std::make_shared<MaterialDiffuse>(std::make_shared<TextureImage>(texturePath));
+        }
+        auto mesh = std::make_shared<TriangleMesh>(std::make_shared<Model>(objPath), toBuilder(obj.value("builder", "sah")));
+        auto& stats = mesh->stats();
+        printf("mesh bvh : %s , face %d , node %d , wide node %d , leaf %d , depth %d , sah %.2f , build %.3f ms \n",
+               BVH::methodName(stats.method), stats.primitives, stats.nodes, stats.wide_nodes, stats.leaves, stats.depth, stats.sah, stats.build_ms);
+        return IObject::load(mesh, material, toTransform(obj.value("transform", json::object())));
+    }
+
+    // 原型中的物体和模型组成一个聚合对象 , 只有一个物体时直接作为原型
+    std::shared_ptr<IObject> toPrototype(const json& obj) {
+        json objects = obj.value("objects", json::object());
+        json models  = obj.value("models", json::array());
+
+        std::vector<std::shared_ptr<IObject>> list;
+        for (auto&& [type, objs] : objects.items()) {
+            for (auto& item : objs) {
+                if (!item.value("hide", false)) list.push_back(toObject(type, item));
+            }
+        }
+        for (auto& model : models) {
+            if (!model.value("hide", false)) list.push_back(toMesh(model));
+        }
+        check(!list.empty(), "prototype is empty");
+        if (list.size() == 1) return list[0];
+        auto group = std::make_shared<Aggregate>();
+        group->addChild(list);
+        return group;
+    }
+
+    // 未指定材质时沿用原型中各物体的材质
+    std::shared_ptr<IObject> toInstance(const json& obj, const std::map<std::string, std::shared_ptr<IObject>>& prototypes) {
+        auto it = prototypes.find(obj.at("prototype"));
+        check(it != prototypes.end(), "prototype not found");
+        auto material = obj.contains("material") ? toMaterial(obj.at("material")) : it->second->getMaterial();
+        return IObject::load(std::make_shared<Instance>(it->second), material, toTransform(obj.value("transform", json::object())));
+    }
+
+    static BVH::Method toBuilder(const std::string& name) {
+        if (name == "sah") {
+            return BVH::Method::SAH;
+        } else if (name == "lbvh") {
+            return BVH::Method::LBVH;
+        } else {
+            throw error("builder type error");
+        }
+    }
+
+    static RsRender::Cull toCull(const std::string& name) {
+        if (name == "none") {
+            return RsRender::Cull::None;
+        } else if (name == "back") {
+            return RsRender::Cull::Back;
+        } else if (name == "front") {
+            return RsRender::Cull::Front;
+        } else {
+            throw error("cull type error");
+        }
+    }
+
     std::shared_ptr<IMaterial> toMaterial(const json& obj) {
         if (obj.is_string()) { // 查询材质表
             auto it = materials.find(obj);
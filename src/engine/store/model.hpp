@@ -6,9 +6,11 @@
 #define MINI_ENGINE_MODEL_HPP
 
 #include "data/transform.hpp"
+#include "accelerator/AABB.hpp"
 #include "interface/shader.hpp"
 #include "interface/texture.hpp"
 #include <vector>
+#include <unordered_map>
 #include <fstream>
 #include <sstream>
 #include <iostream>
@@ -29,6 +31,12 @@ public:
 
     std::vector<std::array<TriangleNode, 3>> triangles{}; // 三角形集合(储存在vertices中的下标)
 
+    // 索引缓存 : 位置和纹理坐标都相同的顶点只保留一份 , 光栅化时每个顶点只变换一次
+    std::vector<TriangleNode>       nodes{};   // 去重后的顶点
+    std::vector<std::array<int, 3>> indices{}; // 三角形在nodes中的下标 , 与triangles一一对应
+
+    AABB box; // 顶点的包围盒(局部坐标)
+
     Transform transform; // 模型自身的变换
 
     std::shared_ptr<ITexture> colorTexture; // 颜色纹理信息
@@ -76,6 +84,8 @@ public:
             }
         }
         in.close();
+        updateBox();
+        updateIndices();
         printf("vertex : %d , face : %d \n", vertex_count(), face_count());
     }
 
@@ -93,6 +103,28 @@ public:
     //        out.close();
     //    }
 
+    // 根据顶点更新包围盒
+    void updateBox() {
+        box = {};
+        for (auto& vertex : vertices) box.expand(vertex);
+    }
+
+    // 根据triangles重建索引缓存
+    void updateIndices() {
+        nodes.clear(), indices.clear();
+        std::unordered_map<int64_t, int> index_of; // (pos,tex) => 在nodes中的下标
+        for (auto& abc : triangles) {
+            std::array<int, 3> index{};
+            for (int i = 0; i < 3; ++i) {
+                int64_t key = int64_t(abc[i].pos) << 32 | uint32_t(abc[i].tex);
+                auto [it, inserted] = index_of.try_emplace(key, int(nodes.size()));
+                if (inserted) nodes.push_back(abc[i]);
+                index[i] = it->second;
+            }
+            indices.push_back(index);
+        }
+    }
+
 public:
     int vertex_count() const { return (int) vertices.size(); }
     int face_count() const { return (int) triangles.size(); }
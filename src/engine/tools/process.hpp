@@ -38,9 +38,10 @@ public:
         printf("process : %.4f%% , leave : ???\n", 0.0);
     }
 
-    void update() {
-        int cur = ++process;
-        if (cur % freq == 0) {
+    void update(int step = 1) {
+        int cur = process += step;
+        // 跨过了一个打印周期
+        if (cur / freq != (cur - step) / freq) {
             std::unique_lock locker(lock);
             printf("process : %.4f%% , ", (double) cur / total * 100);
             // speed = process / (clock() - start) , 1进度/ms
@@ -0,0 +1,130 @@
+﻿//
+// Created by IMEI on 2022/9/13.
+//
+
+#ifndef MINI_ENGINE_SCHEDULER_HPP
+#define MINI_ENGINE_SCHEDULER_HPP
+
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <algorithm>
+#include <functional>
+#include <cstdint>
+#ifdef _OPENMP
+    #include <omp.h>
+#endif
+
+namespace mne {
+
+// 视口中的一个图块 , 范围为[x0,x1)x[y0,y1)
+struct Tile {
+    int x0, y0, x1, y1;
+
+    int area() const { return (x1 - x0) * (y1 - y0); }
+};
+
+// 图块完成后的回调 , 会在工作线程中调用
+using TileCallback = std::function<void(const Tile&)>;
+
+// 图块调度器
+// - 视口切分为tile_size大小的图块 , 按Morton曲线排序 , 相邻的图块在空间上也相邻
+// - 曲线被切成连续的段分给每个线程的双端队列
+// - 线程从自己队列的头部取任务 , 空闲时从其他线程队列的尾部窃取
+class TileScheduler {
+public:
+    int tile_size = 16; // 图块边长
+
+private:
+    struct WorkQueue {
+        std::deque<int> tasks;
+        std::mutex      lock;
+    };
+
+public:
+    // 并行处理视口中的所有图块 , work会在多个线程中同时调用
+    void run(int width, int height, const TileCallback& work) const {
+        std::vector<Tile> tiles = makeTiles(width, height);
+        int               n     = (int) tiles.size();
+        if (n == 0) return;
+
+        int workers = 1;
+#ifdef _OPENMP
+        workers = std::max(1, std::min(omp_get_max_threads(), n));
+#endif
+        std::vector<WorkQueue> queues(workers);
+        for (int i = 0; i < n; ++i) queues[int(int64_t(i) * workers / n)].tasks.push_back(i);
+
+#pragma omp parallel num_threads(workers)
+        {
+            int id = 0;
+#ifdef _OPENMP
+            id = omp_get_thread_num();
+#endif
+            int task;
+            while (pop(queues[id], task) || steal(queues, id, task)) work(tiles[task]);
+        }
+    }
+
+private:
+    // 按Morton曲线顺序排列的图块
+    std::vector<Tile> makeTiles(int width, int height) const {
+        int size = std::max(1, tile_size);
+        int nx = (width + size - 1) / size, ny = (height + size - 1) / size;
+
+        std::vector<std::pair<uint32_t, Tile>> order;
+        order.reserve(nx * ny);
+        for (int ty = 0; ty < ny; ++ty) {
+            for (int tx = 0; tx < nx; ++tx) {
+                Tile tile{tx * size, ty * size, std::min(width, (tx + 1) * size), std::min(height, (ty + 1) * size)};
+                order.emplace_back(morton(uint32_t(tx), uint32_t(ty)), tile);
+            }
+        }
+        std::sort(order.begin(), order.end(), [](auto& a, auto& b) { return a.first < b.first; });
+
+        std::vector<Tile> tiles;
+        tiles.reserve(order.size());
+        for (auto& [code, tile] : order) tiles.push_back(tile);
+        return tiles;
+    }
+
+    // 交错x和y的二进制位
+    static uint32_t morton(uint32_t x, uint32_t y) {
+        auto spread = [](uint32_t v) {
+            v &= 0xFFFF;
+            v = (v | (v << 8)) & 0x00FF00FF;
+            v = (v | (v << 4)) & 0x0F0F0F0F;
+            v = (v | (v << 2)) & 0x33333333;
+            v = (v | (v << 1)) & 0x55555555;
+            return v;
+        };
+        return spread(x) | (spread(y) << 1);
+    }
+
+    // 从自己的队列头部取任务
+    static bool pop(WorkQueue& queue, int& task) {
+        std::unique_lock locker(queue.lock);
+        if (queue.tasks.empty()) return false;
+        task = queue.tasks.front();
+        queue.tasks.pop_front();
+        return true;
+    }
+
+    // 依次从其他队列尾部窃取任务 , 所有队列为空时返回false
+    static bool steal(std::vector<WorkQueue>& queues, int id, int& task) {
+        int n = (int) queues.size();
+        for (int k = 1; k < n; ++k) {
+            auto&            victim = queues[(id + k) % n];
+            std::unique_lock locker(victim.lock);
+            if (victim.tasks.empty()) continue;
+            task = victim.tasks.back();
+            victim.tasks.pop_back();
+            return true;
+        }
+        return false;
+    }
+};
+
+} // namespace mne
+
+#endif //MINI_ENGINE_SCHEDULER_HPP
@@ -43,6 +43,16 @@ public:
         title(title), width(width), height(height), render(std::move(render)) {
         glfwInit(); // 初始化
 
+        // 渲染中逐个图块更新画面
+        this->render->subscribe([this](const Tile& tile) {
+            std::unique_lock locker(lock);
+            const Image&     src = *(this->render->image);
+            if (image.getWH() != src.getWH()) image.resize(src.getWidth(), src.getHeight());
+            for (int x = tile.x0; x < tile.x1; x++) {
+                for (int y = tile.y0; y < tile.y1; y++) image.setPixel(x, y, src.getPixel(x, y));
+            }
+        });
+
         // 创建渲染线程
         thr = std::jthread([this] {
             while (run) {